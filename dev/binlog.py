@@ -0,0 +1,157 @@
+import os
+import re
+import struct
+import sys
+import time
+
+os.environ["PYGAME_HIDE_SUPPORT_PROMPT"] = "hide"
+import pygame.midi
+import click
+
+# decodes the binary log (lib/binlog.h) streamed by the device as LOG_DATA
+# frames, using the formats listed in lib/binlog_formats.h
+
+SYSEXBIN_ID = 0x7D
+SYSEXBIN_VERSION = 1
+SYSEXBIN_LOG = 0x17
+SYSEXBIN_LOG_DATA = 0x18
+
+FORMATS_PATH = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "..", "lib", "binlog_formats.h"
+)
+
+
+def load_formats(path=FORMATS_PATH):
+    formats = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'\s*BINLOG_FORMAT\((\w+),\s*"(.*)"\)', line)
+            if m:
+                formats.append((m.group(1), m.group(2)))
+    return formats
+
+
+def pack7(raw):
+    out = []
+    for i in range(0, len(raw), 7):
+        chunk = raw[i : i + 7]
+        msb = 0
+        for j, b in enumerate(chunk):
+            msb |= (b >> 7) << j
+        out.append(msb)
+        out.extend(b & 0x7F for b in chunk)
+    return bytes(out)
+
+
+def unpack7(data):
+    out = []
+    for i in range(0, len(data), 8):
+        msb = data[i]
+        for j, b in enumerate(data[i + 1 : i + 8]):
+            out.append(b | (((msb >> j) & 1) << 7))
+    return bytes(out)
+
+
+def format_record(formats, id, args):
+    if id >= len(formats):
+        return f"unknown log id {id} {args}"
+    name, fmt = formats[id]
+    values = []
+    specs = re.findall(r"%[-+ 0-9.]*[dufx]", fmt)
+    for spec, arg in zip(specs, args):
+        if spec.endswith("f"):
+            values.append(struct.unpack("<f", struct.pack("<I", arg))[0])
+        elif spec.endswith("d"):
+            values.append(arg - (1 << 32) if arg & 0x80000000 else arg)
+        else:
+            values.append(arg)
+    try:
+        return fmt % tuple(values)
+    except TypeError:
+        return f"{name} {args}"
+
+
+def decode_records(formats, raw):
+    """decodes a LOG_DATA payload into (dropped, [(time_us, text)])"""
+    dropped = struct.unpack_from("<I", raw, 0)[0]
+    records = []
+    i = 4
+    while i + 8 <= len(raw):
+        head, time_us = struct.unpack_from("<II", raw, i)
+        id = head & 0xFFFF
+        nargs = (head >> 16) & 0xFF
+        args = list(struct.unpack_from(f"<{nargs}I", raw, i + 8))
+        records.append((time_us, format_record(formats, id, args)))
+        i += 8 + nargs * 4
+    return dropped, records
+
+
+def find_device(is_input):
+    for device_id in range(pygame.midi.get_count()):
+        interface, name, dev_input, dev_output, opened = (
+            pygame.midi.get_device_info(device_id)
+        )
+        if "yoctocore" in name.decode("utf-8") and (
+            dev_input if is_input else dev_output
+        ):
+            return device_id
+    return None
+
+
+def send_frame(output, command, raw):
+    frame = bytes([0xF0, SYSEXBIN_ID, SYSEXBIN_VERSION, command])
+    frame += pack7(raw) + b"\xF7"
+    output.write_sys_ex(pygame.midi.time(), frame)
+
+
+@click.command()
+@click.option("--formats", default=FORMATS_PATH, help="path to binlog_formats.h")
+def main(formats):
+    formats = load_formats(formats)
+    pygame.midi.init()
+    input_id = find_device(True)
+    output_id = find_device(False)
+    if input_id is None or output_id is None:
+        print("yoctocore not found")
+        sys.exit(1)
+    midi_in = pygame.midi.Input(input_id)
+    midi_out = pygame.midi.Output(output_id)
+    send_frame(midi_out, SYSEXBIN_LOG, bytes([1]))
+    sysex = []
+    last_dropped = 0
+    try:
+        while True:
+            if not midi_in.poll():
+                time.sleep(0.005)
+                continue
+            for data, _ in midi_in.read(256):
+                for b in data:
+                    if b == 0xF0:
+                        sysex = []
+                    elif b == 0xF7:
+                        if (
+                            len(sysex) > 3
+                            and sysex[0] == SYSEXBIN_ID
+                            and sysex[2] == SYSEXBIN_LOG_DATA
+                        ):
+                            dropped, records = decode_records(
+                                formats, unpack7(bytes(sysex[3:]))
+                            )
+                            if dropped != last_dropped:
+                                print(f"-- {dropped - last_dropped} records dropped")
+                                last_dropped = dropped
+                            for time_us, text in records:
+                                print(f"{time_us / 1e6:12.6f} {text}")
+                        sysex = []
+                    elif b < 0x80:
+                        sysex.append(b)
+    except KeyboardInterrupt:
+        send_frame(midi_out, SYSEXBIN_LOG, bytes([0]))
+    finally:
+        midi_in.close()
+        midi_out.close()
+        pygame.midi.quit()
+
+
+if __name__ == "__main__":
+    main()
@@ -149,8 +149,38 @@ def send_use_raw(use_raw=False):
             continue
 
 
+def send_calibration_points(channel, measured):
+    # measured is the voltage read at each raw setpoint in TABLE_VOLTAGES
+    not_done = True
+    while not_done:
+        output = None
+        try:
+            pygame.midi.init()
+            for device_id in range(pygame.midi.get_count()):
+                interface, name, is_input, is_output, opened = (
+                    pygame.midi.get_device_info(device_id)
+                )
+                if not is_output:
+                    continue
+                if "yoctocore" in name.decode("utf-8"):
+                    output = pygame.midi.Output(device_id)
+                    break
+            for voltage, value in zip(TABLE_VOLTAGES, measured):
+                send_sysex(output, f"calpt_{channel:d}_{voltage:d}_{value:.5f}")
+                time.sleep(0.005)
+            send_sysex(output, f"calset{channel:d}")
+            time.sleep(0.025)
+            not_done = False
+        except:
+            pygame.midi.quit()
+            time.sleep(0.05)
+            continue
+
+
 NUM_TRIALS = 5
 NUM_POINTS = 60
+# raw setpoints of the calibration table, one per volt
+TABLE_VOLTAGES = list(range(-5, 11))
 
 
 def run_calibration(id, use_raw):
@@ -204,6 +234,35 @@ def run_calibration(id, use_raw):
             send_calibration(output_num, slope, intercept)
 
 
+def run_table_calibration(id):
+    # measures every output at each whole volt with the calibration off, the
+    # device corrects linearly between the measured points
+    send_use_raw(True)
+    num_outputs = 8
+    measured = np.zeros((num_outputs, len(TABLE_VOLTAGES), NUM_TRIALS))
+    for trial in tqdm(range(NUM_TRIALS)):
+        for i, voltage in enumerate(TABLE_VOLTAGES):
+            set_voltages([voltage] * num_outputs)
+            measured_voltages = read_voltages()
+            for j in range(num_outputs):
+                measured[j, i, trial] = measured_voltages[j]
+            print(measured[:, i, trial])
+
+    if not os.path.exists(f"calibrations/{id}"):
+        os.makedirs(f"calibrations/{id}")
+    for i in range(num_outputs):
+        output_num = i + 1
+        table = measured[i, :, :].mean(axis=1)
+        np.savez(
+            f"calibrations/{id}/table_{output_num}.npz",
+            voltages=np.array(TABLE_VOLTAGES),
+            measured=measured[i, :, :],
+        )
+        print(f"Table for channel {output_num}: {np.round(table, 4)}")
+        send_calibration_points(output_num, table)
+    send_use_raw(False)
+
+
 def create_printout(id, num_channels=8):
     recalibration_text = ""
 
@@ -306,9 +365,11 @@ def create_printout(id, num_channels=8):
         f.write(recalibration_text)
 
 
-def run_all_calibration(id, test_only=False):
+def run_all_calibration(id, test_only=False, table=True):
     if not test_only:
         run_calibration(id, True)
+        if table:
+            run_table_calibration(id)
     run_calibration(id, False)
     # reset all of them
     for j in range(1, 8 + 1):
@@ -321,11 +382,16 @@ def run_all_calibration(id, test_only=False):
 @click.argument("id", required=True)
 @click.option("--test", is_flag=True, help="Run in test mode")
 @click.option("--print", is_flag=True, help="Print the calibration results")
-def main(id, test, print):
+@click.option(
+    "--table/--no-table",
+    default=True,
+    help="Measure a point per volt on top of the slope and intercept",
+)
+def main(id, test, print, table):
     if print:
         create_printout(id)
     else:
-        run_all_calibration(id, test)
+        run_all_calibration(id, test, table)
 
 
 if __name__ == "__main__":
@@ -2,9 +2,11 @@ package midicom
 
 import (
 	"fmt"
+	"hash/crc32"
 	"os"
 	"os/signal"
 	"strings"
+	"sync"
 	"time"
 
 	log "github.com/schollz/logger"
@@ -21,9 +23,57 @@ func isAvailable(filterMidiName string) bool {
 	return strings.Contains(strings.ToLower(midi.GetInPorts().String()), strings.ToLower(filterMidiName))
 }
 
-var fileContents string
-var fileContentsAsk bool
-var fileContentsReady bool
+// CodeFile is a script downloaded from the device
+type CodeFile struct {
+	Scene    int
+	Output   int
+	Found    bool
+	Contents string
+}
+
+// download being received, filled by the listener
+var downloadMutex sync.Mutex
+var downloadFile CodeFile
+var downloadLength uint32
+var downloadCRC uint32
+var downloadData []byte
+var downloadDone = make(chan CodeFile, 64)
+var downloadErr = make(chan error, 64)
+
+// handleCode collects CODE_HEADER / CODE_PART frames and hands each
+// finished script to whoever is waiting in GetFile / GetAllFiles
+func handleCode(command byte, raw []byte) {
+	downloadMutex.Lock()
+	defer downloadMutex.Unlock()
+	switch command {
+	case sysexBinCodeHeader:
+		if len(raw) < 11 {
+			downloadErr <- fmt.Errorf("short code header")
+			return
+		}
+		downloadFile = CodeFile{Scene: int(raw[0]), Output: int(raw[1]), Found: raw[2] == 0}
+		downloadLength = getU32(raw[3:])
+		downloadCRC = getU32(raw[7:])
+		downloadData = downloadData[:0]
+		if !downloadFile.Found || downloadLength == 0 {
+			downloadDone <- downloadFile
+		}
+	case sysexBinCodePart:
+		if len(raw) < 4 || int(raw[0]) != downloadFile.Scene || int(raw[1]) != downloadFile.Output {
+			return
+		}
+		downloadData = append(downloadData, raw[4:]...)
+		if uint32(len(downloadData)) < downloadLength {
+			return
+		}
+		if crc32.ChecksumIEEE(downloadData) != downloadCRC {
+			downloadErr <- fmt.Errorf("scene %d output %d: crc mismatch", downloadFile.Scene, downloadFile.Output)
+			return
+		}
+		downloadFile.Contents = string(downloadData)
+		downloadDone <- downloadFile
+	}
+}
 
 func doConnection(filterMidiName string) (stop func(), err error) {
 	var midiInput drivers.In
@@ -51,18 +101,17 @@ func doConnection(filterMidiName string) (stop func(), err error) {
 		var ch, key, vel uint8
 		switch {
 		case msg.GetSysEx(&bt):
-			s := strings.TrimSpace(string(bt))
-			fmt.Printf("%s\n", s)
-			if fileContentsAsk && !fileContentsReady {
-				if strings.HasPrefix(s, "LS") {
-					fileContents = s[4:]
-				} else if strings.HasPrefix(s, "LN") {
-					fileContents += s[4:]
-				} else if strings.HasPrefix(s, "LE") {
-					fileContents += s[4:]
-					fileContentsReady = true
+			if len(bt) > 0 && bt[0] == sysexBinID {
+				command, raw, err := decodeSysexBin(bt)
+				if err != nil {
+					log.Error(err)
+					return
 				}
+				handleCode(command, raw)
+				return
 			}
+			s := strings.TrimSpace(string(bt))
+			fmt.Printf("%s\n", s)
 		case msg.GetNoteStart(&ch, &key, &vel) && !sysexOnly:
 			log.Infof("note_on=%s, ch=%v, vel=%v\n", midi.Note(key), ch, vel)
 		case msg.GetNoteEnd(&ch, &key) && !sysexOnly:
@@ -82,31 +131,76 @@ func doConnection(filterMidiName string) (stop func(), err error) {
 	return
 }
 
+// drainDownloads drops results left over from an earlier request
+func drainDownloads() {
+	for {
+		select {
+		case <-downloadDone:
+		case <-downloadErr:
+		default:
+			return
+		}
+	}
+}
+
+// waitDownload blocks until the next script finishes or the device goes
+// quiet for longer than timeout
+func waitDownload(timeout time.Duration) (file CodeFile, err error) {
+	select {
+	case file = <-downloadDone:
+	case err = <-downloadErr:
+	case <-time.After(timeout):
+		err = fmt.Errorf("timeout")
+	}
+	return
+}
+
 func GetFile(scene int, output int) (contents string, err error) {
-	fileContentsAsk = true
-	err = SendText("yoctocore", fmt.Sprintf("%d_%d_24", scene, output))
+	drainDownloads()
+	err = SendBytes("yoctocore", encodeSysexBin(sysexBinCodeGet, []byte{byte(scene), byte(output)}))
 	if err != nil {
 		return
 	}
-	fileContentsAsk = true
-	startTime := time.Now()
-	for {
-		if time.Since(startTime) > 5*time.Second {
-			err = fmt.Errorf("timeout")
-			break
-		}
-		if fileContentsReady {
-			contents = fileContents
-			break
+	file, err := waitDownload(5 * time.Second)
+	if err != nil {
+		return
+	}
+	if !file.Found {
+		err = fmt.Errorf("scene %d output %d has no code", scene, output)
+		return
+	}
+	contents = file.Contents
+	return
+}
+
+// GetAllFiles downloads all 64 scripts in one request, scripts that do not
+// exist come back with Found false
+func GetAllFiles() (files []CodeFile, err error) {
+	drainDownloads()
+	err = SendBytes("yoctocore", encodeSysexBin(sysexBinCodeGet, []byte{sysexBinAllScenes}))
+	if err != nil {
+		return
+	}
+	for i := 0; i < 64; i++ {
+		var file CodeFile
+		file, err = waitDownload(5 * time.Second)
+		if err != nil {
+			return
 		}
-		time.Sleep(100 * time.Millisecond)
+		files = append(files, file)
 	}
-	fileContentsAsk = false
-	fileContentsReady = false
 	return
 }
 
 func SendText(name string, text string) (err error) {
+	sysexMessage := []byte{0xf0}
+	sysexMessage = append(sysexMessage, []byte(text)...)
+	sysexMessage = append(sysexMessage, 0xf7)
+	return SendBytes(name, sysexMessage)
+}
+
+// SendBytes sends a complete SysEx message (including F0 and F7)
+func SendBytes(name string, sysexMessage []byte) (err error) {
 	var midiOutput drivers.Out
 	outs := midi.GetOutPorts()
 	if len(outs) == 0 {
@@ -128,11 +222,8 @@ func SendText(name string, text string) (err error) {
 
 	midiOutput.Open()
 	defer midiOutput.Close()
-	sysexMessage := []byte{0xf0}
-	sysexMessage = append(sysexMessage, []byte(text)...)
-	sysexMessage = append(sysexMessage, 0xf7)
 	midiOutput.Send(sysexMessage)
-	log.Infof("sent text to\n\t'%s'", midiOutput.String())
+	log.Infof("sent %d bytes to\n\t'%s'", len(sysexMessage), midiOutput.String())
 	return
 }
 
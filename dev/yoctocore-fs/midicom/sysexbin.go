@@ -0,0 +1,77 @@
+package midicom
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// binary SysEx framing, see lib/sysexbin.h in the firmware
+const (
+	sysexBinID      = 0x7D
+	sysexBinVersion = 1
+
+	sysexBinAllScenes  = 0x7F
+	sysexBinCodeGet    = 0x0C
+	sysexBinCodeHeader = 0x0D
+	sysexBinCodePart   = 0x0E
+)
+
+// pack7 packs bytes 7-in-8, each group of 7 is preceded by their high bits
+func pack7(raw []byte) (out []byte) {
+	for i := 0; i < len(raw); i += 7 {
+		head := len(out)
+		out = append(out, 0)
+		var msb byte
+		for j := 0; j < 7 && i+j < len(raw); j++ {
+			msb |= (raw[i+j] >> 7) << j
+			out = append(out, raw[i+j]&0x7F)
+		}
+		out[head] = msb
+	}
+	return
+}
+
+func unpack7(packed []byte) (out []byte, err error) {
+	for i := 0; i < len(packed); i += 8 {
+		msb := packed[i]
+		if msb&0x80 != 0 {
+			err = fmt.Errorf("byte %d is not 7-bit", i)
+			return
+		}
+		for j := 0; j < 7 && i+1+j < len(packed); j++ {
+			b := packed[i+1+j]
+			if b&0x80 != 0 {
+				err = fmt.Errorf("byte %d is not 7-bit", i+1+j)
+				return
+			}
+			out = append(out, b|((msb>>j)&1)<<7)
+		}
+	}
+	return
+}
+
+// encodeSysexBin returns a full SysEx message including F0 and F7
+func encodeSysexBin(command byte, raw []byte) []byte {
+	msg := []byte{0xF0, sysexBinID, sysexBinVersion, command}
+	msg = append(msg, pack7(raw)...)
+	return append(msg, 0xF7)
+}
+
+// decodeSysexBin takes a SysEx body (without F0 and F7)
+func decodeSysexBin(body []byte) (command byte, raw []byte, err error) {
+	if len(body) < 3 || body[0] != sysexBinID {
+		err = fmt.Errorf("not a binary frame")
+		return
+	}
+	if body[1] != sysexBinVersion {
+		err = fmt.Errorf("unknown version %d", body[1])
+		return
+	}
+	command = body[2]
+	raw, err = unpack7(body[3:])
+	return
+}
+
+func getU32(raw []byte) uint32 {
+	return binary.LittleEndian.Uint32(raw)
+}
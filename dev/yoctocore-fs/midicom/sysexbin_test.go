@@ -0,0 +1,80 @@
+package midicom
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestPack7(t *testing.T) {
+	for n := 0; n < 300; n++ {
+		raw := make([]byte, n)
+		for i := range raw {
+			raw[i] = byte(i*37 + n)
+		}
+		msg := encodeSysexBin(sysexBinCodePart, raw)
+		for _, b := range msg[1 : len(msg)-1] {
+			if b&0x80 != 0 {
+				t.Fatalf("%d: byte %x is not 7-bit", n, b)
+			}
+		}
+		command, back, err := decodeSysexBin(msg[1 : len(msg)-1])
+		if err != nil || command != sysexBinCodePart || !bytes.Equal(back, raw) {
+			t.Fatalf("%d: round trip failed: %v", n, err)
+		}
+	}
+}
+
+// a script download as the firmware sends it, the same frames are checked
+// against the C codec in lib/tests/sysexbin
+var firmwareHeader = []byte{0x7D, 0x01, 0x0D, 0x00, 0x02, 0x05,
+	0x00, 0x0B, 0x00, 0x00, 0x00, 0x07,
+	0x44, 0x4D, 0x75, 0x46}
+var firmwarePart = []byte{0x7D, 0x01, 0x0E, 0x00, 0x02, 0x05, 0x00,
+	0x00, 0x70, 0x72, 0x69, 0x00, 0x6E, 0x74,
+	0x28, 0x22, 0x68, 0x69, 0x22, 0x00, 0x29}
+
+const firmwareCode = `print("hi")`
+
+func decodeFirmwareFrame(t *testing.T, body []byte, want byte) []byte {
+	command, raw, err := decodeSysexBin(body)
+	if err != nil || command != want {
+		t.Fatalf("decode %x: command %x, %v", want, command, err)
+	}
+	msg := encodeSysexBin(command, raw)
+	if !bytes.Equal(msg[1:len(msg)-1], body) {
+		t.Fatalf("encode %x: got % x, firmware sends % x", want, msg[1:len(msg)-1], body)
+	}
+	return raw
+}
+
+func TestFirmwareFrames(t *testing.T) {
+	header := decodeFirmwareFrame(t, firmwareHeader, sysexBinCodeHeader)
+	part := decodeFirmwareFrame(t, firmwarePart, sysexBinCodePart)
+
+	handleCode(sysexBinCodeHeader, header)
+	handleCode(sysexBinCodePart, part)
+	select {
+	case file := <-downloadDone:
+		if file.Scene != 2 || file.Output != 5 || !file.Found || file.Contents != firmwareCode {
+			t.Fatalf("got %+v", file)
+		}
+	case err := <-downloadErr:
+		t.Fatal(err)
+	default:
+		t.Fatal("download did not finish")
+	}
+
+	// a corrupted crc in the header rejects the script
+	corrupted := append([]byte{}, firmwareHeader...)
+	corrupted[len(corrupted)-1] ^= 0x01
+	header = decodeFirmwareFrame(t, corrupted, sysexBinCodeHeader)
+	handleCode(sysexBinCodeHeader, header)
+	handleCode(sysexBinCodePart, part)
+	select {
+	case file := <-downloadDone:
+		t.Fatalf("corrupted download accepted: %+v", file)
+	case <-downloadErr:
+	default:
+		t.Fatal("corrupted download was not rejected")
+	}
+}
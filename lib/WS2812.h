@@ -26,7 +26,22 @@
 #define WS2812_H
 
 #define NUM_LEDS_MAX 32
+#include <math.h>
+
 #include "WS2812.pio.h"
+#include "hardware/dma.h"
+
+// Colors go through two 256 entry tables built up front, a gamma curve for
+// callers that map a level to a color and the brightness scale applied to
+// every fill, so a frame is table lookups and shifts. WS2812_show hands the
+// frame to DMA, which feeds the PIO FIFO on its own, and skips frames that
+// did not change.
+
+#define WS2812_GAMMA 0.8f
+// each LED takes 24 bits at 800 kHz, plus the latch and what is still in
+// the joined FIFO when the DMA finishes
+#define WS2812_LED_US 30
+#define WS2812_LATCH_US 300
 
 const uint8_t ws2812_brightness_values[16] = {
     0, 1, 2, 3, 4, 6, 10, 15, 21, 30, 39, 51, 64, 80, 97, 117,
@@ -42,8 +57,23 @@ typedef struct WS2812 {
   uint32_t data[NUM_LEDS_MAX];
   uint8_t brightness;
   uint8_t num_leds;
+  uint8_t gamma[256];
+  // brightness scale of each channel value
+  uint8_t scale[256];
+  // copy of data being sent, so fills during a transfer do not tear it
+  uint32_t frame[NUM_LEDS_MAX];
+  int dma_channel;
+  bool dirty;
+  uint32_t sent_us;
+  uint32_t frame_us;
 } WS2812;
 
+void WS2812_set_scale(WS2812 *ws) {
+  for (uint16_t i = 0; i < 256; i++) {
+    ws->scale[i] = (i * ws->brightness) / 255;
+  }
+}
+
 void WS2812_init(WS2812 *ws, uint pin, PIO pio, uint sm, uint8_t num_leds) {
   ws->num_leds = num_leds;
   ws->pin = pin;
@@ -51,6 +81,14 @@ void WS2812_init(WS2812 *ws, uint pin, PIO pio, uint sm, uint8_t num_leds) {
   ws->sm = sm;
   ws->brightness = 255;
   memset(ws->data, 0, sizeof(ws->data));
+  memset(ws->frame, 0, sizeof(ws->frame));
+  ws->dirty = true;
+  ws->sent_us = 0;
+  ws->frame_us = num_leds * WS2812_LED_US + WS2812_LATCH_US;
+  for (uint16_t i = 0; i < 256; i++) {
+    ws->gamma[i] = roundf(255.0f * powf(i / 255.0f, WS2812_GAMMA));
+  }
+  WS2812_set_scale(ws);
   ws->bytes[0] = 0;
   ws->bytes[1] = 2;
   ws->bytes[2] = 1;
@@ -58,8 +96,20 @@ void WS2812_init(WS2812 *ws, uint pin, PIO pio, uint sm, uint8_t num_leds) {
   uint offset = pio_add_program(pio, &ws2812_program);
   uint bits = 24;
   ws2812_program_init(pio, sm, offset, pin, 800000, bits);
+
+  ws->dma_channel = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(ws->dma_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+  dma_channel_configure(ws->dma_channel, &c, &pio->txf[sm], ws->frame,
+                        num_leds, false);
 }
 
+// WS2812_gamma returns a level from 0 to 255 on the gamma curve.
+uint8_t WS2812_gamma(WS2812 *ws, uint8_t level) { return ws->gamma[level]; }
+
 void WS2812_set_brightness(WS2812 *ws, uint8_t brightness) {
   // brightness between 0 and 100
   if (brightness > 100) {
@@ -69,6 +119,7 @@ void WS2812_set_brightness(WS2812 *ws, uint8_t brightness) {
   if (brightness > 0 && ws->brightness == 0) {
     ws->brightness = 1;
   }
+  WS2812_set_scale(ws);
   return;
 }
 
@@ -86,9 +137,9 @@ void WS2812_fill(WS2812 *ws, int index, uint8_t red, uint8_t green,
     return;  // Safety check to avoid overflow
   }
   // scale by brightness level
-  red = (red * ws->brightness) / 255;
-  green = (green * ws->brightness) / 255;
-  blue = (blue * ws->brightness) / 255;
+  red = ws->scale[red];
+  green = ws->scale[green];
+  blue = ws->scale[blue];
   uint32_t rgbw =
       (uint32_t)(blue) << 16 | (uint32_t)(green) << 8 | (uint32_t)(red);
   uint32_t result = 0;
@@ -109,7 +160,10 @@ void WS2812_fill(WS2812 *ws, int index, uint8_t red, uint8_t green,
     }
     result <<= 8;
   }
-  ws->data[index] = result;  // Store data for the specified LED
+  if (ws->data[index] != result) {
+    ws->data[index] = result;  // Store data for the specified LED
+    ws->dirty = true;
+  }
   return;
 }
 
@@ -147,10 +201,19 @@ void WS2812_set_color(WS2812 *ws, uint8_t index, enum WS2812_Color color,
   return;
 }
 
+// WS2812_show starts sending the frame if it changed and returns straight
+// away. A frame that comes too soon after the last one stays pending until
+// the next call.
 void WS2812_show(WS2812 *ws) {
-  for (int i = 0; i < ws->num_leds; i++) {
-    pio_sm_put_blocking(ws->pio, ws->sm, ws->data[i]);
+  if (!ws->dirty || dma_channel_is_busy(ws->dma_channel) ||
+      time_us_32() - ws->sent_us < ws->frame_us) {
+    return;
   }
+  memcpy(ws->frame, ws->data, ws->num_leds * sizeof(uint32_t));
+  ws->dirty = false;
+  ws->sent_us = time_us_32();
+  dma_channel_transfer_from_buffer_now(ws->dma_channel, ws->frame,
+                                       ws->num_leds);
   return;
 }
 
@@ -16,7 +16,8 @@ typedef struct ADSR {
   float level_attack;
   float level_release;
   float level_start;
-  float start_time;
+  // milliseconds, fractions come from the fast DAC rate
+  double start_time;
   float shape;
   float max;
   int32_t state;
@@ -39,7 +40,7 @@ void ADSR_init(ADSR *adsr, float attack, float decay, float sustain,
   adsr->max = 1.0;
 }
 
-void ADSR_gate(ADSR *adsr, bool gate, uint32_t current_time_ms) {
+void ADSR_gate(ADSR *adsr, bool gate, double current_time_ms) {
   if (adsr->gate == gate) {
     return;
   }
@@ -53,9 +54,13 @@ void ADSR_gate(ADSR *adsr, bool gate, uint32_t current_time_ms) {
   adsr->start_time = current_time_ms;
 }
 
-float ADSR_process(ADSR *adsr, float current_time_ms) {
+float ADSR_process(ADSR *adsr, double current_time_ms) {
+  if (current_time_ms < adsr->start_time) {
+    // gated at a time stamp later than the caller's clock
+    current_time_ms = adsr->start_time;
+  }
   if (adsr->state == env_attack) {
-    int32_t elapsed = current_time_ms - adsr->start_time;
+    double elapsed = current_time_ms - adsr->start_time;
     float curve_shape = adsr->attack / adsr->shape;
     adsr->level =
         adsr->level_start + (adsr->max - adsr->level_start) *
@@ -69,7 +74,7 @@ float ADSR_process(ADSR *adsr, float current_time_ms) {
   }
 
   if (adsr->state == env_decay) {
-    int32_t elapsed = current_time_ms - adsr->start_time;
+    double elapsed = current_time_ms - adsr->start_time;
     if (elapsed >= adsr->decay) {
       adsr->state = env_sustain;
       adsr->start_time = current_time_ms - (elapsed - adsr->decay);
@@ -91,7 +96,7 @@ float ADSR_process(ADSR *adsr, float current_time_ms) {
   }
 
   if (adsr->state == env_release) {
-    int32_t elapsed = current_time_ms - adsr->start_time;
+    double elapsed = current_time_ms - adsr->start_time;
     if (elapsed >= adsr->release * 2) {
       adsr->state = env_idle;
       adsr->level = 0;
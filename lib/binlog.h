@@ -0,0 +1,153 @@
+#ifndef LIB_BINLOG_H
+#define LIB_BINLOG_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// BinLog records log messages as a format id, a timestamp and the raw
+// 32-bit arguments in a RAM ring, so logging costs a few word copies
+// instead of a printf that formats floats in software and blocks on stdio.
+// The formats live in binlog_formats.h and are only ever turned into text
+// on the host (dev/binlog.py). A record is
+//
+//   <id u16 | nargs << 16> <time us u32> <args u32 ...>
+//
+// Each subsystem has a compile time level (BINLOG_LEVEL_<SUBSYSTEM>), a
+// message above it compiles to nothing. Define BINLOG_ECHO to also printf
+// every message as it is logged, for debugging over serial.
+
+#define BINLOG_ERROR 1
+#define BINLOG_WARN 2
+#define BINLOG_INFO 3
+#define BINLOG_DEBUG 4
+
+#ifndef BINLOG_LEVEL_KNOB
+#define BINLOG_LEVEL_KNOB BINLOG_INFO
+#endif
+#ifndef BINLOG_LEVEL_BUTTON
+#define BINLOG_LEVEL_BUTTON BINLOG_INFO
+#endif
+#ifndef BINLOG_LEVEL_MIDI
+#define BINLOG_LEVEL_MIDI BINLOG_INFO
+#endif
+#ifndef BINLOG_LEVEL_LUA
+#define BINLOG_LEVEL_LUA BINLOG_INFO
+#endif
+#ifndef BINLOG_LEVEL_SYSTEM
+#define BINLOG_LEVEL_SYSTEM BINLOG_INFO
+#endif
+
+#define BINLOG_FORMAT(name, format) BINLOG_ID_##name,
+enum {
+#include "binlog_formats.h"
+  BINLOG_ID_COUNT
+};
+#undef BINLOG_FORMAT
+
+#ifdef BINLOG_ECHO
+#define BINLOG_FORMAT(name, format) format,
+const char *binlog_formats[] = {
+#include "binlog_formats.h"
+};
+#undef BINLOG_FORMAT
+#endif
+
+// ring size in 32-bit words
+#define BINLOG_WORDS 1024
+#define BINLOG_MAX_ARGS 8
+// bytes of records sent per frame
+#define BINLOG_DATA_SIZE 256
+
+typedef struct BinLog {
+  uint32_t words[BINLOG_WORDS];
+  uint16_t head;
+  uint16_t tail;
+  // records dropped because the ring was full
+  uint32_t dropped;
+  uint32_t logged;
+} BinLog;
+
+BinLog binlog;
+
+void BinLog_init(BinLog *self) {
+  self->head = 0;
+  self->tail = 0;
+  self->dropped = 0;
+  self->logged = 0;
+}
+
+uint16_t BinLog_used(BinLog *self) {
+  return (self->head - self->tail) & (BINLOG_WORDS - 1);
+}
+
+// BinLog_write adds a record, dropping it if the ring is full.
+void BinLog_write(BinLog *self, uint16_t id, uint32_t time_us,
+                  const uint32_t *args, uint8_t nargs) {
+  if (nargs > BINLOG_MAX_ARGS) {
+    nargs = BINLOG_MAX_ARGS;
+  }
+  if (BINLOG_WORDS - 1 - BinLog_used(self) < 2 + nargs) {
+    self->dropped++;
+    return;
+  }
+  uint16_t h = self->head;
+  self->words[h] = id | ((uint32_t)nargs << 16);
+  h = (h + 1) & (BINLOG_WORDS - 1);
+  self->words[h] = time_us;
+  for (uint8_t i = 0; i < nargs; i++) {
+    h = (h + 1) & (BINLOG_WORDS - 1);
+    self->words[h] = args[i];
+  }
+  self->head = (h + 1) & (BINLOG_WORDS - 1);
+  self->logged++;
+}
+
+// BinLog_read copies whole records, as little endian bytes, into out until
+// max bytes would be exceeded. Returns the number of bytes.
+uint16_t BinLog_read(BinLog *self, uint8_t *out, uint16_t max) {
+  uint16_t len = 0;
+  while (self->tail != self->head) {
+    uint8_t nargs = (self->words[self->tail] >> 16) & 0xFF;
+    uint16_t size = (2 + nargs) * 4;
+    if (len + size > max) {
+      break;
+    }
+    for (uint8_t i = 0; i < 2 + nargs; i++) {
+      uint32_t w = self->words[self->tail];
+      out[len++] = w & 0xFF;
+      out[len++] = (w >> 8) & 0xFF;
+      out[len++] = (w >> 16) & 0xFF;
+      out[len++] = (w >> 24) & 0xFF;
+      self->tail = (self->tail + 1) & (BINLOG_WORDS - 1);
+    }
+  }
+  return len;
+}
+
+// BINLOG_F passes a float argument as its bits
+static inline uint32_t BINLOG_F(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+#ifdef BINLOG_ECHO
+#define BINLOG_ECHO_PRINT(id) printf("[binlog] %s\n", binlog_formats[id])
+#else
+#define BINLOG_ECHO_PRINT(id)
+#endif
+
+// BINLOG(subsystem, level, name, args...) logs BINLOG_ID_<name> if level is
+// enabled for the subsystem. There must be at least one argument.
+#define BINLOG(subsystem, level, name, ...)                             \
+  do {                                                                  \
+    if ((level) <= BINLOG_LEVEL_##subsystem) {                          \
+      const uint32_t binlog_args[] = {__VA_ARGS__};                     \
+      BinLog_write(&binlog, BINLOG_ID_##name, time_us_32(), binlog_args, \
+                   sizeof(binlog_args) / sizeof(binlog_args[0]));       \
+      BINLOG_ECHO_PRINT(BINLOG_ID_##name);                              \
+    }                                                                   \
+  } while (0)
+
+#endif
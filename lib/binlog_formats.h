@@ -0,0 +1,36 @@
+// BINLOG_FORMAT(name, format) lists every binary log message. The id of a
+// message is its position in this list, which is also how dev/binlog.py
+// decodes it, so only ever add messages at the end. Arguments are 32-bit:
+// %d / %u for integers and %f for floats (logged with BINLOG_F).
+
+BINLOG_FORMAT(KNOB, "knob %d: %f")
+BINLOG_FORMAT(LUA_ON_KNOB, "lua on_knob #%d val=%f")
+BINLOG_FORMAT(BUTTON, "button %d: %d")
+BINLOG_FORMAT(LUA_ON_BUTTON, "lua on_button #%d val=%d")
+BINLOG_FORMAT(TUNING, "[out%d] tuning %d")
+BINLOG_FORMAT(TAP_TEMPO, "[out%d] tap tempo %d")
+BINLOG_FORMAT(GATE_LINKED, "[out%d] gate linked to out%d")
+BINLOG_FORMAT(FREE_HEAP, "free_heap %d")
+BINLOG_FORMAT(GC, "gc at free_heap %d took %d us")
+BINLOG_FORMAT(NOTE_ON, "ch=%d note_on=%d vel=%d")
+BINLOG_FORMAT(NOTE_OFF, "ch=%d note_off=%d")
+BINLOG_FORMAT(NOTE_OFF_OUT, "[out%d] note_off %d")
+BINLOG_FORMAT(LUA_ON_NOTE_ON, "lua on_note_on #%d ch=%d note=%d vel=%d")
+BINLOG_FORMAT(LUA_ON_NOTE_OFF, "lua on_note_off #%d ch=%d note=%d")
+BINLOG_FORMAT(CC, "ch=%d cc=%d val=%d")
+BINLOG_FORMAT(CC_OUT, "[cc%d] %f")
+BINLOG_FORMAT(LUA_ON_CC, "lua on_cc #%d cc=%d val=%d")
+BINLOG_FORMAT(KEY_PRESSURE, "ch=%d note=%d pressure=%d")
+BINLOG_FORMAT(KEY_PRESSURE_OUT, "[kp%d] %f")
+BINLOG_FORMAT(PROGRAM_CHANGE, "ch=%d program=%d")
+BINLOG_FORMAT(PROGRAM_CHANGE_OUT, "[pc%d] %f")
+BINLOG_FORMAT(CHANNEL_PRESSURE, "ch=%d pressure=%d")
+BINLOG_FORMAT(CHANNEL_PRESSURE_OUT, "[cp%d] %f")
+BINLOG_FORMAT(PITCH_BEND, "ch=%d pitch_bend=%d")
+BINLOG_FORMAT(PITCH_BEND_OUT, "[pb%d] %f")
+BINLOG_FORMAT(MIDI_START, "midi start ch=%d")
+BINLOG_FORMAT(MIDI_CONTINUE, "midi continue ch=%d")
+BINLOG_FORMAT(MIDI_STOP, "midi stop ch=%d")
+BINLOG_FORMAT(DAC_TIMING, "dac update %d us (max %d us), %d i2c errors")
+BINLOG_FORMAT(MIDICLOCK_LOCK, "[midiclock] locked=%d %2.2f bpm")
+BINLOG_FORMAT(NOTE_ON_OUT, "[out%d] note_on %d root %d v/oct %f min %f to %f")
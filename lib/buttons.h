@@ -0,0 +1,163 @@
+#ifndef LIB_BUTTONS_H
+#define LIB_BUTTONS_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef LINUX_SYSTEM
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+#endif
+
+// Buttons turns button edges into a queue of timestamped events. Every edge
+// raises a GPIO interrupt that reads the timer straight away, so the time
+// of a press does not depend on how busy the main loop is. An edge is taken
+// if it changes the state of its button and the button has been steady for
+// BUTTONS_DEBOUNCE_US; the bounces after it are ignored. If the bounces end
+// on a level that was ignored, Buttons_poll takes it once the pin has
+// settled, timestamped when it was polled.
+//
+// Buttons are active low and pressed is true while the pin is low.
+
+#define BUTTONS_MAX 9
+#define BUTTONS_QUEUE 32
+#define BUTTONS_DEBOUNCE_US 5000
+
+typedef struct ButtonEvent {
+  // time_us_64() at the edge
+  uint64_t time_us;
+  uint8_t button;
+  bool pressed;
+} ButtonEvent;
+
+typedef struct Buttons {
+  uint8_t num;
+  uint8_t pins[BUTTONS_MAX];
+  // debounced state, a bit per button
+  volatile uint16_t state;
+  // state as last handed out by Buttons_next
+  uint16_t delivered;
+  uint64_t changed_us[BUTTONS_MAX];
+  // written by the interrupt, read by the main loop
+  ButtonEvent queue[BUTTONS_QUEUE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+  volatile uint32_t dropped;
+} Buttons;
+
+void Buttons_queue(Buttons *self, uint8_t button, bool pressed,
+                   uint64_t now_us) {
+  uint8_t next = (self->head + 1) % BUTTONS_QUEUE;
+  if (next == self->tail) {
+    self->dropped++;
+    return;
+  }
+  self->queue[self->head].time_us = now_us;
+  self->queue[self->head].button = button;
+  self->queue[self->head].pressed = pressed;
+  self->head = next;
+}
+
+// Buttons_edge takes a level seen on a button at now_us and queues an event
+// if it is a debounced change. Returns true if the state changed.
+bool Buttons_edge(Buttons *self, uint8_t button, bool pressed,
+                  uint64_t now_us) {
+  bool state = (self->state >> button) & 1;
+  if (pressed == state ||
+      now_us - self->changed_us[button] < BUTTONS_DEBOUNCE_US) {
+    return false;
+  }
+  self->changed_us[button] = now_us;
+  self->state ^= 1 << button;
+  Buttons_queue(self, button, pressed, now_us);
+  return true;
+}
+
+// Buttons_next takes the oldest event off the queue, false if it is empty.
+bool Buttons_next(Buttons *self, ButtonEvent *event) {
+  if (self->tail == self->head) {
+    return false;
+  }
+  *event = self->queue[self->tail];
+  self->tail = (self->tail + 1) % BUTTONS_QUEUE;
+  if (event->pressed) {
+    self->delivered |= 1 << event->button;
+  } else {
+    self->delivered &= ~(1 << event->button);
+  }
+  return true;
+}
+
+// Buttons_flush drops the queued events when they were left unread long
+// enough to be stale. Buttons let go since the last event handed out are
+// queued as releases at now_us so none is left held; presses are not
+// replayed, the release that follows one is.
+void Buttons_flush(Buttons *self, uint64_t now_us) {
+  self->tail = self->head;
+  for (uint8_t i = 0; i < self->num; i++) {
+    if (((self->delivered >> i) & 1) && !((self->state >> i) & 1)) {
+      Buttons_queue(self, i, false, now_us);
+    }
+  }
+}
+
+bool Buttons_pressed(Buttons *self, uint8_t button) {
+  return (self->state >> button) & 1;
+}
+
+void Buttons_reset(Buttons *self, uint8_t num) {
+  self->num = num > BUTTONS_MAX ? BUTTONS_MAX : num;
+  self->state = 0;
+  self->delivered = 0;
+  self->head = 0;
+  self->tail = 0;
+  self->dropped = 0;
+  for (uint8_t i = 0; i < BUTTONS_MAX; i++) {
+    self->changed_us[i] = 0;
+  }
+}
+
+#ifndef LINUX_SYSTEM
+Buttons *buttons_irq_instance = NULL;
+
+void Buttons_irq(uint gpio, uint32_t events) {
+  Buttons *self = buttons_irq_instance;
+  uint64_t now = time_us_64();
+  for (uint8_t i = 0; i < self->num; i++) {
+    if (self->pins[i] == gpio) {
+      Buttons_edge(self, i, !gpio_get(gpio), now);
+      return;
+    }
+  }
+}
+
+// Buttons_init sets up the pins with pull ups and starts taking edges.
+// Buttons held at power up come through as presses from Buttons_poll.
+void Buttons_init(Buttons *self, const uint8_t *pins, uint8_t num) {
+  Buttons_reset(self, num);
+  buttons_irq_instance = self;
+  for (uint8_t i = 0; i < self->num; i++) {
+    self->pins[i] = pins[i];
+    gpio_init(pins[i]);
+    gpio_set_dir(pins[i], GPIO_IN);
+    gpio_pull_up(pins[i]);
+    gpio_set_irq_enabled_with_callback(
+        pins[i], GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, Buttons_irq);
+  }
+}
+
+// Buttons_poll catches levels that the interrupts ignored while debouncing.
+void Buttons_poll(Buttons *self) {
+  for (uint8_t i = 0; i < self->num; i++) {
+    bool pressed = !gpio_get(self->pins[i]);
+    if (pressed != Buttons_pressed(self, i)) {
+      uint32_t status = save_and_disable_interrupts();
+      Buttons_edge(self, i, pressed, time_us_64());
+      restore_interrupts(status);
+    }
+  }
+}
+#endif
+
+#endif
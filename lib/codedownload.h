@@ -0,0 +1,104 @@
+#ifndef LIB_CODEDOWNLOAD_H
+#define LIB_CODEDOWNLOAD_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sysexbin.h"
+
+// CodeDownload reads a Lua script from the SD card a chunk at a time so it
+// can be streamed out as the tx queue drains, instead of loading the whole
+// file and blocking until every chunk is sent. A download can also walk
+// through all 64 scripts, one after the other.
+
+#define CODEDOWNLOAD_OK 0
+#define CODEDOWNLOAD_NO_FILE 1
+
+typedef struct CodeDownload {
+  FIL file;
+  bool active;
+  // binary frames with a length/crc header, otherwise LS/LN/LE text
+  bool binary;
+  uint8_t scene;
+  uint8_t output;
+  uint32_t len;
+  uint32_t sent;
+  uint32_t crc;
+  uint16_t seq;
+  // next script of a download of all scripts, -1 when not batching
+  int8_t batch_next;
+} CodeDownload;
+
+void CodeDownload_init(CodeDownload *self) {
+  self->active = false;
+  self->batch_next = -1;
+}
+
+void CodeDownload_stop(CodeDownload *self) {
+  if (self->active) {
+    f_close(&self->file);
+    self->active = false;
+  }
+}
+
+// CodeDownload_start opens a script and, for binary downloads, takes its
+// crc32 in one pass over the file. Returns CODEDOWNLOAD_NO_FILE if there is
+// no script.
+uint8_t CodeDownload_start(CodeDownload *self, uint8_t scene, uint8_t output,
+                           bool binary) {
+  CodeDownload_stop(self);
+  self->binary = binary;
+  self->scene = scene;
+  self->output = output;
+  self->len = 0;
+  self->sent = 0;
+  self->crc = 0;
+  self->seq = 0;
+  char fname[32];
+  snprintf(fname, sizeof(fname), "scene%d_output%d.lua", scene + 1,
+           output + 1);
+  FRESULT fr = f_open(&self->file, fname, FA_READ);
+  if (fr != FR_OK) {
+    return CODEDOWNLOAD_NO_FILE;
+  }
+  self->len = f_size(&self->file);
+  if (binary) {
+    uint8_t buffer[128];
+    UINT br;
+    do {
+      fr = f_read(&self->file, buffer, sizeof(buffer), &br);
+      if (fr != FR_OK) {
+        printf("f_read error: %s (%d)\n", FRESULT_str(fr), fr);
+        f_close(&self->file);
+        return CODEDOWNLOAD_NO_FILE;
+      }
+      self->crc = SysExBin_crc32_update(self->crc, buffer, br);
+    } while (br == sizeof(buffer));
+    f_rewind(&self->file);
+  }
+  self->active = true;
+  return CODEDOWNLOAD_OK;
+}
+
+// CodeDownload_read fills data with the next chunk and returns its size,
+// closing the file after the last one.
+uint16_t CodeDownload_read(CodeDownload *self, uint8_t *data, uint16_t max) {
+  if (!self->active) {
+    return 0;
+  }
+  UINT br = 0;
+  FRESULT fr = f_read(&self->file, data, max, &br);
+  if (fr != FR_OK) {
+    printf("f_read error: %s (%d)\n", FRESULT_str(fr), fr);
+    br = 0;
+  }
+  self->sent += br;
+  self->seq++;
+  if (br == 0 || self->sent >= self->len) {
+    CodeDownload_stop(self);
+  }
+  return br;
+}
+
+#endif
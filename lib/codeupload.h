@@ -0,0 +1,162 @@
+#ifndef LIB_CODEUPLOAD_H
+#define LIB_CODEUPLOAD_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sysexbin.h"
+
+// CodeUpload streams a Lua script straight into a temp file on the SD card
+// and renames it over scene<s>_output<o>.lua once it is complete, so the
+// script is never held in RAM and a broken upload leaves the old one alone.
+// FatFs cannot rename over an existing file, so the old script is kept as
+// <name>.bak until the rename succeeds, and CodeUpload_recover puts it
+// back if power was lost in between.
+//
+// Chunks carry a sequence number and are only written in order. Duplicates
+// and gaps are refused with the next expected sequence, in-order chunks are
+// acknowledged every CODEUPLOAD_ACK_EVERY chunks. That lets the host keep
+// CODEUPLOAD_WINDOW chunks in flight and go back on a refusal.
+
+#define CODEUPLOAD_TEMP "upload.tmp"
+#define CODEUPLOAD_BACKUP ".bak"
+#define CODEUPLOAD_WINDOW 4
+#define CODEUPLOAD_ACK_EVERY 2
+
+#define CODEUPLOAD_OK 0
+#define CODEUPLOAD_SEQUENCE 1
+#define CODEUPLOAD_BAD_CRC 2
+#define CODEUPLOAD_BAD_SIZE 3
+#define CODEUPLOAD_FILE_ERROR 4
+#define CODEUPLOAD_IDLE 5
+
+typedef struct CodeUpload {
+  FIL file;
+  bool active;
+  uint8_t scene;
+  uint8_t output;
+  // announced length and crc32, length 0 skips the checks
+  uint32_t expected_len;
+  uint32_t expected_crc;
+  uint32_t len;
+  uint32_t crc;
+  uint16_t next_seq;
+} CodeUpload;
+
+void CodeUpload_init(CodeUpload *self) { self->active = false; }
+
+void CodeUpload_abort(CodeUpload *self) {
+  if (!self->active) {
+    return;
+  }
+  self->active = false;
+  f_close(&self->file);
+  f_unlink(CODEUPLOAD_TEMP);
+}
+
+bool CodeUpload_begin(CodeUpload *self, uint8_t scene, uint8_t output,
+                      uint32_t expected_len, uint32_t expected_crc) {
+  CodeUpload_abort(self);
+  FRESULT fr =
+      f_open(&self->file, CODEUPLOAD_TEMP, FA_WRITE | FA_CREATE_ALWAYS);
+  if (fr != FR_OK) {
+    printf("f_open error: %s (%d): %s\n", FRESULT_str(fr), fr,
+           CODEUPLOAD_TEMP);
+    return false;
+  }
+  self->active = true;
+  self->scene = scene;
+  self->output = output;
+  self->expected_len = expected_len;
+  self->expected_crc = expected_crc;
+  self->len = 0;
+  self->crc = 0;
+  self->next_seq = 0;
+  return true;
+}
+
+// CodeUpload_write appends chunk seq. Returns CODEUPLOAD_SEQUENCE for
+// anything but the next expected chunk.
+uint8_t CodeUpload_write(CodeUpload *self, uint16_t seq, const uint8_t *data,
+                         uint16_t len) {
+  if (!self->active) {
+    return CODEUPLOAD_IDLE;
+  }
+  if (seq != self->next_seq) {
+    return CODEUPLOAD_SEQUENCE;
+  }
+  if (self->expected_len > 0 && self->len + len > self->expected_len) {
+    CodeUpload_abort(self);
+    return CODEUPLOAD_BAD_SIZE;
+  }
+  UINT bw;
+  FRESULT fr = f_write(&self->file, data, len, &bw);
+  if (fr != FR_OK || bw != len) {
+    printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+    CodeUpload_abort(self);
+    return CODEUPLOAD_FILE_ERROR;
+  }
+  self->len += len;
+  self->crc = SysExBin_crc32_update(self->crc, data, len);
+  self->next_seq++;
+  return CODEUPLOAD_OK;
+}
+
+// CodeUpload_finish checks length and crc and moves the temp file into
+// place.
+uint8_t CodeUpload_finish(CodeUpload *self) {
+  if (!self->active) {
+    return CODEUPLOAD_IDLE;
+  }
+  if (self->expected_len > 0) {
+    if (self->len != self->expected_len) {
+      CodeUpload_abort(self);
+      return CODEUPLOAD_BAD_SIZE;
+    }
+    if (self->crc != self->expected_crc) {
+      CodeUpload_abort(self);
+      return CODEUPLOAD_BAD_CRC;
+    }
+  }
+  self->active = false;
+  FRESULT fr = f_close(&self->file);
+  if (fr != FR_OK) {
+    printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
+    f_unlink(CODEUPLOAD_TEMP);
+    return CODEUPLOAD_FILE_ERROR;
+  }
+  char fname[32];
+  char bname[36];
+  snprintf(fname, sizeof(fname), "scene%d_output%d.lua", self->scene + 1,
+           self->output + 1);
+  snprintf(bname, sizeof(bname), "%s" CODEUPLOAD_BACKUP, fname);
+  f_unlink(bname);
+  fr = f_rename(fname, bname);
+  if (fr != FR_OK && fr != FR_NO_FILE) {
+    printf("f_rename error: %s (%d): %s\n", FRESULT_str(fr), fr, fname);
+    f_unlink(CODEUPLOAD_TEMP);
+    return CODEUPLOAD_FILE_ERROR;
+  }
+  fr = f_rename(CODEUPLOAD_TEMP, fname);
+  if (fr != FR_OK) {
+    printf("f_rename error: %s (%d): %s\n", FRESULT_str(fr), fr, fname);
+    f_rename(bname, fname);
+    return CODEUPLOAD_FILE_ERROR;
+  }
+  f_unlink(bname);
+  return CODEUPLOAD_OK;
+}
+
+// CodeUpload_recover puts back the previous script if an upload was cut
+// off after it was moved aside and before the new one took its place.
+void CodeUpload_recover(const char *fname) {
+  char bname[36];
+  snprintf(bname, sizeof(bname), "%s" CODEUPLOAD_BACKUP, fname);
+  if (f_stat(fname, NULL) == FR_NO_FILE && f_stat(bname, NULL) == FR_OK) {
+    printf("restoring %s\n", bname);
+    f_rename(bname, fname);
+  }
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef LIB_CVSTREAM_H
+#define LIB_CVSTREAM_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CvStream turns the outputs into a computer controlled CV interface. The
+// host sends frames of all 8 voltages (millivolts), each stamped with its
+// position in the stream in units of the stream period. Frames go into a
+// jitter buffer and the control tick plays them out against the local
+// clock: playback starts once depth frames are buffered, after that the
+// frame due at the current time is applied, no matter how bursty the USB
+// delivery was. A frame that is late is overtaken by the next one due, a
+// frame older than one already received is dropped, and an empty buffer
+// holds the last voltages and waits for depth frames again. If the host
+// clock runs fast the buffer grows and playback skips ahead a frame.
+
+#define CVSTREAM_FRAMES 64
+#define CVSTREAM_PERIOD_DEFAULT_US 4000
+#define CVSTREAM_PERIOD_MIN_US 1000
+#define CVSTREAM_DEPTH_DEFAULT 8
+// frames per CV_FRAMES message, all 8 outputs as int16 mV
+#define CVSTREAM_BATCH 16
+#define CVSTREAM_FRAME_SIZE 16
+// CV_FRAMES batches between two status replies
+#define CVSTREAM_STATUS_EVERY 8
+
+typedef struct CvStreamFrame {
+  uint32_t ts;
+  int16_t mv[8];
+} CvStreamFrame;
+
+typedef struct CvStream {
+  // bit mask of the outputs driven by the stream, 0 when stopped
+  uint8_t channels;
+  uint32_t period_us;
+  uint8_t depth;
+  // transport the stream was started from
+  uint8_t transport;
+
+  CvStreamFrame ring[CVSTREAM_FRAMES];
+  uint8_t head;
+  uint8_t tail;
+  bool playing;
+  uint64_t start_us;
+  uint32_t start_ts;
+  // newest frame received
+  uint32_t last_ts;
+  bool have_last;
+  int16_t current[8];
+  // current holds a frame, the streamed outputs follow it
+  bool applied;
+
+  uint32_t received;
+  uint32_t late;
+  uint32_t underruns;
+  uint32_t overflows;
+} CvStream;
+
+void CvStream_init(CvStream *self) {
+  self->channels = 0;
+  self->period_us = CVSTREAM_PERIOD_DEFAULT_US;
+  self->depth = CVSTREAM_DEPTH_DEFAULT;
+  self->transport = 0;
+  self->head = 0;
+  self->tail = 0;
+  self->playing = false;
+  self->start_us = 0;
+  self->start_ts = 0;
+  self->last_ts = 0;
+  self->have_last = false;
+  for (uint8_t i = 0; i < 8; i++) {
+    self->current[i] = 0;
+  }
+  self->applied = false;
+  self->received = 0;
+  self->late = 0;
+  self->underruns = 0;
+  self->overflows = 0;
+}
+
+// CvStream_start resets the buffer, channels 0 stops the stream.
+void CvStream_start(CvStream *self, uint8_t channels, uint32_t period_us,
+                    uint8_t depth) {
+  CvStream_init(self);
+  self->channels = channels;
+  if (period_us == 0) {
+    period_us = CVSTREAM_PERIOD_DEFAULT_US;
+  } else if (period_us < CVSTREAM_PERIOD_MIN_US) {
+    period_us = CVSTREAM_PERIOD_MIN_US;
+  }
+  self->period_us = period_us;
+  if (depth == 0) {
+    depth = CVSTREAM_DEPTH_DEFAULT;
+  } else if (depth > CVSTREAM_FRAMES / 2) {
+    depth = CVSTREAM_FRAMES / 2;
+  }
+  self->depth = depth;
+}
+
+uint8_t CvStream_fill(CvStream *self) {
+  return (self->head - self->tail) & (CVSTREAM_FRAMES - 1);
+}
+
+// CvStream_push adds a frame. Returns false if it was dropped because it is
+// older than one already received or the buffer is full.
+bool CvStream_push(CvStream *self, uint32_t ts, const int16_t *mv) {
+  self->received++;
+  if (self->have_last && (int32_t)(ts - self->last_ts) <= 0) {
+    self->late++;
+    return false;
+  }
+  uint8_t next = (self->head + 1) & (CVSTREAM_FRAMES - 1);
+  if (next == self->tail) {
+    self->overflows++;
+    return false;
+  }
+  self->ring[self->head].ts = ts;
+  for (uint8_t i = 0; i < 8; i++) {
+    self->ring[self->head].mv[i] = mv[i];
+  }
+  self->head = next;
+  self->last_ts = ts;
+  self->have_last = true;
+  return true;
+}
+
+// CvStream_play writes the frame due at now_us to volts (only the streamed
+// channels), or the last one while waiting. Returns true if a new frame
+// was applied.
+bool CvStream_play(CvStream *self, uint64_t now_us, float *volts) {
+  if (self->channels == 0) {
+    return false;
+  }
+  uint8_t fill = CvStream_fill(self);
+  if (!self->playing && fill >= self->depth) {
+    self->playing = true;
+    self->start_us = now_us;
+    self->start_ts = self->ring[self->tail].ts;
+  } else if (self->playing && fill > 2 * self->depth) {
+    // host clock is ahead, catch up by a frame
+    self->start_us -= self->period_us;
+  }
+  bool changed = false;
+  if (self->playing) {
+    uint32_t position = self->start_ts + (uint32_t)((now_us - self->start_us) /
+                                                    self->period_us);
+    while (self->tail != self->head &&
+           (int32_t)(self->ring[self->tail].ts - position) <= 0) {
+      for (uint8_t i = 0; i < 8; i++) {
+        self->current[i] = self->ring[self->tail].mv[i];
+      }
+      self->tail = (self->tail + 1) & (CVSTREAM_FRAMES - 1);
+      changed = true;
+      self->applied = true;
+    }
+    if (self->tail == self->head && (int32_t)(position - self->last_ts) > 0) {
+      // ran dry, hold the voltages until the buffer is full again
+      self->underruns++;
+      self->playing = false;
+    }
+  }
+  if (self->applied) {
+    for (uint8_t i = 0; i < 8; i++) {
+      if (self->channels & (1 << i)) {
+        volts[i] = self->current[i] / 1000.0f;
+      }
+    }
+  }
+  return changed;
+}
+
+#endif
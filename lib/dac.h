@@ -2,72 +2,161 @@
 #ifndef DAC_LIB
 #define DAC_LIB 1
 
+#include <string.h>
+
+#include "daccode.h"
 #include "mcp4728.h"
 
 typedef struct DAC {
   MCP4728 mcp4728[2];
-  float voltages[8];
-  float voltages_last[8];
+  // 12-bit codes, voltages are converted as they are set and each chip
+  // tracks which of its channels changed
+  uint16_t codes[8];
   float voltage_calibration_slope[8];
   float voltage_calibration_intercept[8];
   bool use_raw[8];
+  // measured calibration tables, used instead of the slope and intercept
+  // of the channels that have one
+  float calibration_points[8][DACCODE_POINTS];
+  bool use_points[8];
+  // calibration folded into fixed point, see daccode.h
+  DacCode code[8];
+  // rounding error carried by outputs set with DAC_set_voltage_dither
+  int32_t dither_error[8];
+  // the two chips are on separate buses and are written at the same time,
+  // update_us is from the start of an update until both have finished
+  volatile uint8_t updating;
+  uint32_t update_start_us;
+  volatile uint32_t update_us;
+  volatile uint32_t update_us_max;
 } DAC;
 
+void DAC_on_done(MCP4728 *mcp4728, bool ok, void *user) {
+  DAC *self = (DAC *)user;
+  uint8_t chip = mcp4728 == &self->mcp4728[0] ? 1 : 2;
+  if (!(self->updating & chip)) {
+    return;
+  }
+  self->updating &= ~chip;
+  if (self->updating == 0) {
+    self->update_us = time_us_32() - self->update_start_us;
+    if (self->update_us > self->update_us_max) {
+      self->update_us_max = self->update_us;
+    }
+  }
+}
+
 void DAC_init(DAC *self) {
+  self->updating = 0;
+  self->update_us = 0;
+  self->update_us_max = 0;
   MCP4728_init(&self->mcp4728[0], i2c0, false, REFERENCE_5V);
   MCP4728_init(&self->mcp4728[1], i2c1, false, REFERENCE_5V);
+  MCP4728_set_callback(&self->mcp4728[0], DAC_on_done, self);
+  MCP4728_set_callback(&self->mcp4728[1], DAC_on_done, self);
   for (int i = 0; i < 8; i++) {
     self->use_raw[i] = false;
-    self->voltages[i] = 0;
-    self->voltages_last[i] = -1;
+    self->use_points[i] = false;
+    self->codes[i] = 0;
+    self->dither_error[i] = 0;
     self->voltage_calibration_slope[i] = 0;
     self->voltage_calibration_intercept[i] = 0;
+    DacCode_set(&self->code[i], 0, 0, false, REFERENCE_5V);
+  }
+}
+
+// DAC_fold_calibration recomputes the fixed point conversion of a channel.
+void DAC_fold_calibration(DAC *self, int channel) {
+  if (self->use_points[channel] && !self->use_raw[channel]) {
+    DacCode_set_points(&self->code[channel],
+                       self->calibration_points[channel], REFERENCE_5V);
+  } else {
+    DacCode_set(&self->code[channel], self->voltage_calibration_slope[channel],
+                self->voltage_calibration_intercept[channel],
+                self->use_raw[channel], REFERENCE_5V);
+  }
+}
+
+// DAC_set_calibration changes the calibration of a channel, which takes
+// effect from the next voltage set.
+void DAC_set_calibration(DAC *self, int channel, float slope,
+                         float intercept) {
+  if (channel < 0 || channel >= 8) {
+    return;
+  }
+  self->voltage_calibration_slope[channel] = slope;
+  self->voltage_calibration_intercept[channel] = intercept;
+  self->use_points[channel] = false;
+  DAC_fold_calibration(self, channel);
+}
+
+// DAC_set_calibration_points calibrates a channel with a table of the
+// voltages measured at each raw setpoint (see daccode.h). Returns false and
+// keeps the old calibration if the table does not look like a measurement.
+bool DAC_set_calibration_points(DAC *self, int channel,
+                                const float *measured) {
+  if (channel < 0 || channel >= 8 || !DacCode_points_valid(measured)) {
+    return false;
   }
+  memcpy(self->calibration_points[channel], measured,
+         sizeof(self->calibration_points[channel]));
+  self->use_points[channel] = true;
+  DAC_fold_calibration(self, channel);
+  return true;
 }
 
+// DAC_set_raw skips the calibration of a channel, for measuring it.
+void DAC_set_raw(DAC *self, int channel, bool raw) {
+  if (channel < 0 || channel >= 8) {
+    return;
+  }
+  self->use_raw[channel] = raw;
+  DAC_fold_calibration(self, channel);
+}
+
+// DAC_update starts writing the channels whose codes changed and returns
+// without waiting for the buses.
 void DAC_update(DAC *self) {
-  bool mcp4728_changed[2] = {false, false};
+  bool mcp4728_changed[2] = {self->mcp4728[0].dirty != 0,
+                             self->mcp4728[1].dirty != 0};
+  if (self->updating == 0 && (mcp4728_changed[0] || mcp4728_changed[1])) {
+    self->update_start_us = time_us_32();
+    self->updating = mcp4728_changed[0] | (mcp4728_changed[1] << 1);
+  }
   for (int i = 0; i < 2; i++) {
-    // see if changed
-    for (int j = 0; j < 4; j++) {
-      if (self->voltages[j + i * 4] != self->voltages_last[j + i * 4]) {
-        mcp4728_changed[i] = true;
-        break;
-      }
-    }
     if (mcp4728_changed[i]) {
       MCP4728_update(&self->mcp4728[i]);
     }
   }
-  for (int i = 0; i < 8; i++) {
-    self->voltages_last[i] = self->voltages[i];
-  }
 }
 
 void DAC_set_voltage(DAC *self, int channel, float voltage) {
   if (channel < 0 || channel >= 8) {
     return;
   }
-  if (self->use_raw[channel]) {
-    // use voltage as it is
-  } else if (self->voltage_calibration_intercept[channel] != 0) {
-      // calculate adjusted setpoint
-      voltage = (voltage - self->voltage_calibration_intercept[channel]) /
-                self->voltage_calibration_slope[channel];
+  uint16_t code = DacCode_from_voltage(&self->code[channel], voltage);
+  self->codes[channel] = code;
+  if (channel < 4) {
+    MCP4728_set_code(&self->mcp4728[0], channel, code);
+  } else {
+    MCP4728_set_code(&self->mcp4728[1], channel - 4, code);
   }
-  // convert voltage from -5-10 to 0-5
-  voltage = (voltage + 5.0f) / 3.0f;
-  if (voltage < 0) {
-    voltage = 0;
-  } else if (voltage > REFERENCE_5V) {
-    voltage = REFERENCE_5V;
+}
+
+// DAC_set_voltage_dither sets a voltage between two DAC steps by
+// alternating between them over the following updates, for outputs where
+// the average matters more than the ripple (held pitches).
+void DAC_set_voltage_dither(DAC *self, int channel, float voltage) {
+  if (channel < 0 || channel >= 8) {
+    return;
   }
-  voltage = REFERENCE_5V - voltage;
-  self->voltages[channel] = voltage;
+  uint16_t code = DacCode_dither(&self->code[channel], voltage,
+                                 &self->dither_error[channel]);
+  self->codes[channel] = code;
   if (channel < 4) {
-    MCP4728_set_voltage(&self->mcp4728[0], channel, voltage);
+    MCP4728_set_code(&self->mcp4728[0], channel, code);
   } else {
-    MCP4728_set_voltage(&self->mcp4728[1], channel - 4, voltage);
+    MCP4728_set_code(&self->mcp4728[1], channel - 4, code);
   }
 }
 
@@ -76,4 +165,11 @@ void DAC_set_voltage_update(DAC *self, int channel, float voltage) {
   DAC_update(self);
 }
 
+// DAC_wait blocks until both chips have their voltages, for the few places
+// (calibration, shutting down) that need the outputs settled.
+void DAC_wait(DAC *self) {
+  MCP4728_wait(&self->mcp4728[0]);
+  MCP4728_wait(&self->mcp4728[1]);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,152 @@
+#ifndef LIB_DACCODE_H
+#define LIB_DACCODE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// DacCode turns an output voltage into the 12-bit MCP4728 code with integer
+// math. The output stage turns a DAC voltage u in 0..ref into
+// 3 * (ref - u) - 5 volts, so the code is
+//
+//   code = 4095 - 4095 / (3 * ref) * (v' + 5)
+//
+// where v' is the calibrated setpoint (v - intercept) / slope. That is a
+// straight line in v, so the calibration is folded into one gain and offset
+// (Q16.16 codes per volt and codes) whenever it changes, and each update is
+// a multiply, a shift and a clamp.
+//
+// A calibration table measures the output at one raw setpoint per volt
+// from DACCODE_POINT_MIN. Between two measured points the correction is a
+// straight line, so the table compiles into one gain and offset per piece
+// and an update first finds its piece, which is almost always the one its
+// volt lands in.
+
+#define DACCODE_MAX 4095
+#define DACCODE_ONE 65536
+// voltages are clamped to this before going to fixed point
+#define DACCODE_VOLTAGE_LIMIT 64.0f
+// calibration tables have a point per volt over the output range
+#define DACCODE_POINTS 16
+#define DACCODE_POINT_MIN -5
+#define DACCODE_SEGMENTS (DACCODE_POINTS - 1)
+
+typedef struct DacCode {
+  // straight pieces in use, 1 for a slope and intercept
+  uint8_t segments;
+  // Q16.16 volts where each piece starts, the first and last extend past
+  // the ends of the table
+  int32_t knee[DACCODE_SEGMENTS];
+  // Q16.16 codes per volt, subtracted
+  int32_t gain[DACCODE_SEGMENTS];
+  // Q16.16 code at 0 volts
+  int64_t offset[DACCODE_SEGMENTS];
+} DacCode;
+
+// DacCode_set computes the coefficients. Uncalibrated outputs (intercept or
+// slope 0) and raw outputs use the nominal line.
+void DacCode_set(DacCode *self, float slope, float intercept, bool raw,
+                 float reference) {
+  double scale = (double)DACCODE_MAX / (3.0 * reference);
+  double gain = scale;
+  double offset = DACCODE_MAX - scale * 5.0;
+  if (!raw && intercept != 0 && slope != 0) {
+    gain = scale / slope;
+    offset += scale * intercept / slope;
+  }
+  self->segments = 1;
+  self->knee[0] = 0;
+  self->gain[0] = (int32_t)(gain * DACCODE_ONE + 0.5);
+  self->offset[0] = (int64_t)(offset * DACCODE_ONE + 0.5);
+}
+
+// DacCode_points_valid checks a table of measured voltages: each point must
+// be about a volt above the one before, anything else is a bad measurement.
+bool DacCode_points_valid(const float *measured) {
+  for (uint8_t k = 1; k < DACCODE_POINTS; k++) {
+    float step = measured[k] - measured[k - 1];
+    if (!(step > 0.5f && step < 1.5f)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// DacCode_set_points compiles a table of the voltages measured at the raw
+// setpoints DACCODE_POINT_MIN, DACCODE_POINT_MIN + 1, ... The table must
+// pass DacCode_points_valid.
+void DacCode_set_points(DacCode *self, const float *measured,
+                        float reference) {
+  double scale = (double)DACCODE_MAX / (3.0 * reference);
+  self->segments = DACCODE_SEGMENTS;
+  for (uint8_t k = 0; k < DACCODE_SEGMENTS; k++) {
+    double m0 = measured[k];
+    double m1 = measured[k + 1];
+    double setpoint = DACCODE_POINT_MIN + k;
+    // the raw setpoint is setpoint + (v - m0) / (m1 - m0)
+    double gain = scale / (m1 - m0);
+    double offset = DACCODE_MAX - scale * (setpoint + 5.0) + gain * m0;
+    self->knee[k] = (int32_t)(m0 * DACCODE_ONE);
+    self->gain[k] = (int32_t)(gain * DACCODE_ONE + 0.5);
+    self->offset[k] = (int64_t)(offset * DACCODE_ONE + 0.5);
+  }
+}
+
+// DacCode_exact returns the unrounded code in Q16.16, clamped to the range.
+int32_t DacCode_exact(DacCode *self, float voltage) {
+  if (voltage > DACCODE_VOLTAGE_LIMIT) {
+    voltage = DACCODE_VOLTAGE_LIMIT;
+  } else if (voltage < -DACCODE_VOLTAGE_LIMIT) {
+    voltage = -DACCODE_VOLTAGE_LIMIT;
+  }
+  int32_t v = (int32_t)(voltage * (float)DACCODE_ONE);
+  int32_t k = 0;
+  if (self->segments > 1) {
+    // start from the piece of the volt and step to the measured knee
+    k = (v >> 16) - DACCODE_POINT_MIN;
+    if (k < 0) {
+      k = 0;
+    } else if (k >= self->segments) {
+      k = self->segments - 1;
+    }
+    while (k > 0 && v < self->knee[k]) {
+      k--;
+    }
+    while (k + 1 < self->segments && v >= self->knee[k + 1]) {
+      k++;
+    }
+  }
+  int64_t code = self->offset[k] - (((int64_t)self->gain[k] * v) >> 16);
+  if (code <= 0) {
+    return 0;
+  } else if (code >= (int64_t)DACCODE_MAX * DACCODE_ONE) {
+    return DACCODE_MAX * DACCODE_ONE;
+  }
+  return (int32_t)code;
+}
+
+uint16_t DacCode_from_voltage(DacCode *self, float voltage) {
+  return (DacCode_exact(self, voltage) + DACCODE_ONE / 2) >> 16;
+}
+
+// DacCode_dither rounds with error feedback: the part of the code lost to
+// rounding is carried in *error and added to the next update, so over a
+// few updates the codes alternate between the two nearest steps and average
+// to the exact code.
+uint16_t DacCode_dither(DacCode *self, float voltage, int32_t *error) {
+  int32_t exact = DacCode_exact(self, voltage);
+  int32_t want = exact + *error;
+  int32_t code = (want + DACCODE_ONE / 2) >> 16;
+  if (code < 0) {
+    code = 0;
+  } else if (code > DACCODE_MAX) {
+    code = DACCODE_MAX;
+  }
+  *error = want - code * DACCODE_ONE;
+  // at the ends of the range the error can never be paid back
+  if (*error > DACCODE_ONE || *error < -DACCODE_ONE) {
+    *error = 0;
+  }
+  return (uint16_t)code;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef LIB_FASTDAC_H
+#define LIB_FASTDAC_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adsr.h"
+#include "dac.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+// FastDac runs the envelopes and lfos of selected outputs from a hardware
+// alarm at up to FASTDAC_RATE_MAX instead of the 250 Hz DAC tick, and
+// writes the DAC from there. Like MidiClockOut the alarm reschedules itself
+// relative to when it was due. A tick that runs past the next one is
+// counted as an overrun and the schedule restarts from now, so a rate the
+// bus or the cpu cannot keep up with slows down instead of starving the
+// main loop. FastDac_benchmark measures what each number of outputs can
+// reach (see the README).
+
+#define FASTDAC_RATE_MIN 500
+#define FASTDAC_RATE_MAX 10000
+#define FASTDAC_RATE_DEFAULT 2000
+
+typedef void (*FastDac_tick_fn)(uint8_t mask, uint64_t now_us);
+
+typedef struct FastDac {
+  // outputs run at the fast rate
+  volatile uint8_t mask;
+  uint32_t rate_hz;
+  uint32_t period_us;
+  volatile uint64_t due_us;
+  alarm_id_t alarm;
+  FastDac_tick_fn tick;
+  volatile uint32_t ticks;
+  volatile uint32_t overruns;
+  volatile uint32_t tick_us;
+  volatile uint32_t tick_us_max;
+} FastDac;
+
+FastDac fastdac;
+
+int64_t FastDac_alarm(alarm_id_t id, void *user_data) {
+  FastDac *self = (FastDac *)user_data;
+  uint64_t now = time_us_64();
+  self->tick(self->mask, now);
+  uint64_t done = time_us_64();
+  self->tick_us = done - now;
+  if (self->tick_us > self->tick_us_max) {
+    self->tick_us_max = self->tick_us;
+  }
+  self->ticks++;
+  self->due_us += self->period_us;
+  if (done >= self->due_us) {
+    self->overruns++;
+    self->due_us = done + self->period_us;
+    return self->period_us;
+  }
+  // negative means relative to when this alarm was due
+  return -(int64_t)self->period_us;
+}
+
+void FastDac_init(FastDac *self, FastDac_tick_fn tick) {
+  self->mask = 0;
+  self->rate_hz = FASTDAC_RATE_DEFAULT;
+  self->period_us = 1000000 / FASTDAC_RATE_DEFAULT;
+  self->due_us = 0;
+  self->alarm = 0;
+  self->tick = tick;
+  self->ticks = 0;
+  self->overruns = 0;
+  self->tick_us = 0;
+  self->tick_us_max = 0;
+}
+
+void FastDac_stop(FastDac *self) {
+  if (self->alarm > 0) {
+    cancel_alarm(self->alarm);
+    self->alarm = 0;
+  }
+  self->mask = 0;
+}
+
+// FastDac_start runs the outputs in mask at rate_hz, mask 0 stops.
+void FastDac_start(FastDac *self, uint8_t mask, uint32_t rate_hz) {
+  FastDac_stop(self);
+  if (mask == 0) {
+    return;
+  }
+  if (rate_hz < FASTDAC_RATE_MIN) {
+    rate_hz = FASTDAC_RATE_MIN;
+  } else if (rate_hz > FASTDAC_RATE_MAX) {
+    rate_hz = FASTDAC_RATE_MAX;
+  }
+  self->rate_hz = rate_hz;
+  self->period_us = 1000000 / rate_hz;
+  self->ticks = 0;
+  self->overruns = 0;
+  self->tick_us_max = 0;
+  uint32_t status = save_and_disable_interrupts();
+  self->mask = mask;
+  self->due_us = time_us_64() + self->period_us;
+  restore_interrupts(status);
+  self->alarm = add_alarm_in_us(self->period_us, FastDac_alarm, self, true);
+}
+
+bool FastDac_running(FastDac *self) { return self->alarm > 0; }
+
+bool FastDac_has(FastDac *self, uint8_t output) {
+  return self->alarm > 0 && (self->mask & (1 << output));
+}
+
+// FastDac_benchmark times one fast tick of the first n outputs: cpu_us for
+// evaluating an envelope in its attack and setting the DAC code for each,
+// bus_us for writing them. The codes are sent unchanged so the outputs do
+// not move. Must be called with the fast rate stopped.
+void FastDac_benchmark(DAC *dac, uint8_t n, uint32_t *cpu_us,
+                       uint32_t *bus_us) {
+  ADSR adsr[8];
+  uint64_t now = time_us_64();
+  for (uint8_t i = 0; i < n; i++) {
+    ADSR_init(&adsr[i], 1000.0f, 1000.0f, 0.5f, 1000.0f, 5.0f);
+    ADSR_gate(&adsr[i], true, now / 1000.0);
+  }
+  DAC_wait(dac);
+  uint32_t start = time_us_32();
+  for (uint8_t i = 0; i < n; i++) {
+    float level = ADSR_process(&adsr[i], now / 1000.0 + 0.5);
+    volatile uint16_t code = DacCode_from_voltage(&dac->code[i], level);
+    // resend the code already there so the output does not move
+    (void)code;
+    dac->mcp4728[i / 4].dirty |= 1 << (i % 4);
+  }
+  *cpu_us = time_us_32() - start;
+  DAC_update(dac);
+  DAC_wait(dac);
+  *bus_us = dac->update_us;
+}
+
+#endif
@@ -1,48 +1,83 @@
 #ifndef KNOB_CHANGE_LIB
 #define KNOB_CHANGE_LIB 1
 
+#include <stdbool.h>
 #include <stdint.h>
 
+// KnobChange smooths a knob and reports when it moved. Positions are
+// fractional, from 0 to KNOB_CHANGE_MAX. The smoothing adapts to speed:
+// the further the input is from the smoothed position the faster it
+// follows, so a knob turned quickly has no lag and a knob at rest or
+// turned slowly settles without jitter. A change is reported once the
+// smoothed position has moved more than the threshold from the last
+// reported one.
+
+#define KNOB_CHANGE_MAX 1023.0f
+// fraction of the distance followed per update at rest
+#define KNOB_CHANGE_ALPHA_MIN 0.04f
+// distance at which the position follows the input outright
+#define KNOB_CHANGE_DISTANCE_FULL 24.0f
+// the ends snap so the full range can be reached
+#define KNOB_CHANGE_END 0.5f
+
 typedef struct {
-  int16_t last;
-  uint8_t debounce;
-  uint8_t threshold;
+  // smoothed position
+  float value;
+  // last position reported as a change
+  float last;
+  float threshold;
+  bool started;
   uint8_t changed;
 } KnobChange;
 
-void KnobChange_init(KnobChange *self, uint8_t threshold) {
+void KnobChange_init(KnobChange *self, float threshold) {
+  self->value = 0;
   self->last = -1;
-  self->debounce = 0;
   self->threshold = threshold < 0 ? -threshold : threshold;
+  self->started = false;
   self->changed = 0;
 }
 
-int16_t KnobChange_update(KnobChange *self, int16_t val) {
-  if (self->debounce) {
-    self->debounce--;
+// KnobChange_update takes the raw position and returns the smoothed
+// position if it changed, -1 if not.
+float KnobChange_update(KnobChange *self, float val) {
+  if (!self->started) {
+    self->value = val;
   }
 
-  if (self->last == -1) {
-    self->last = val;
+  float distance = val - self->value;
+  float speed = (distance < 0 ? -distance : distance) /
+                KNOB_CHANGE_DISTANCE_FULL;
+  float alpha = KNOB_CHANGE_ALPHA_MIN + (1.0f - KNOB_CHANGE_ALPHA_MIN) * speed;
+  if (alpha > 1.0f) {
+    alpha = 1.0f;
+  }
+  self->value += alpha * distance;
+  if (self->value < KNOB_CHANGE_END) {
+    self->value = 0;
+  } else if (self->value > KNOB_CHANGE_MAX - KNOB_CHANGE_END) {
+    self->value = KNOB_CHANGE_MAX;
   }
 
-  int16_t diff = val - self->last;
-  if (diff > self->threshold || diff < -self->threshold) {
-    self->changed = 1;
-    self->last = val;
-    self->debounce = 5;
-  } else if (self->debounce > 0) {
-    self->last = val;
-    self->changed = 1;
-  } else {
-    self->changed = 0;
+  if (!self->started) {
+    // where the knob is at power up is not a change
+    self->started = true;
+    self->last = self->value;
     return -1;
   }
 
-  return self->last;
+  float moved = self->value - self->last;
+  if (moved > self->threshold || moved < -self->threshold ||
+      (self->value != self->last &&
+       (self->value == 0 || self->value == KNOB_CHANGE_MAX))) {
+    self->last = self->value;
+    self->changed = 1;
+    return self->last;
+  }
+  return -1;
 }
 
-int16_t KnobChange_get(KnobChange *self) {
+float KnobChange_get(KnobChange *self) {
   if (self->changed) {
     self->changed = 0;
     return self->last;
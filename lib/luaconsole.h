@@ -0,0 +1,133 @@
+#ifndef LIB_LUACONSOLE_H
+#define LIB_LUACONSOLE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// LuaConsole collects what scripts print() so that printing from inside a
+// callback only costs a copy into RAM. Lines are tagged with the output
+// whose script printed them (0 for the REPL) and the time, and the main
+// loop sends them to the editor when the tx queue has room. Each output may
+// print LUACONSOLE_RATE lines a second with bursts of LUACONSOLE_BURST,
+// anything over that, or arriving while the ring is full, is dropped and
+// counted. The number of lines dropped since the previous line is sent
+// with each line so the editor can show the gap.
+
+#define LUACONSOLE_LINES 32
+#define LUACONSOLE_LINE_SIZE 96
+#define LUACONSOLE_RATE 20
+#define LUACONSOLE_BURST 10
+// the tag of lines printed from the REPL, scripts are tagged 1 to 8
+#define LUACONSOLE_REPL 0
+
+typedef struct LuaConsoleLine {
+  uint32_t time_ms;
+  uint16_t dropped;
+  uint8_t output;
+  uint8_t len;
+  char text[LUACONSOLE_LINE_SIZE];
+} LuaConsoleLine;
+
+typedef struct LuaConsole {
+  LuaConsoleLine lines[LUACONSOLE_LINES];
+  uint8_t head;
+  uint8_t tail;
+  // lines each output (and the REPL) may still print, in 1/1000 lines
+  int32_t tokens[9];
+  uint32_t refill_ms;
+  // dropped since the last line that made it in
+  uint16_t pending_dropped;
+  uint32_t dropped_full;
+  uint32_t dropped_rate;
+  uint32_t printed;
+} LuaConsole;
+
+void LuaConsole_init(LuaConsole *self) {
+  self->head = 0;
+  self->tail = 0;
+  for (uint8_t i = 0; i < 9; i++) {
+    self->tokens[i] = LUACONSOLE_BURST * 1000;
+  }
+  self->refill_ms = 0;
+  self->pending_dropped = 0;
+  self->dropped_full = 0;
+  self->dropped_rate = 0;
+  self->printed = 0;
+}
+
+// LuaConsole_script_output is the tag for the script of the output at
+// index, which counts from 0 like the rest of the firmware.
+uint8_t LuaConsole_script_output(int index) { return index + 1; }
+
+uint8_t LuaConsole_available(LuaConsole *self) {
+  return (self->head - self->tail) % LUACONSOLE_LINES;
+}
+
+void LuaConsole_refill(LuaConsole *self, uint32_t now_ms) {
+  uint32_t elapsed = now_ms - self->refill_ms;
+  if (elapsed == 0) {
+    return;
+  }
+  self->refill_ms = now_ms;
+  if (elapsed > 1000) {
+    elapsed = 1000;
+  }
+  for (uint8_t i = 0; i < 9; i++) {
+    self->tokens[i] += elapsed * LUACONSOLE_RATE;
+    if (self->tokens[i] > LUACONSOLE_BURST * 1000) {
+      self->tokens[i] = LUACONSOLE_BURST * 1000;
+    }
+  }
+}
+
+// LuaConsole_push copies a line in, cutting it at LUACONSOLE_LINE_SIZE.
+// Returns false if it was dropped.
+bool LuaConsole_push(LuaConsole *self, uint8_t output, uint32_t now_ms,
+                     const char *text, uint32_t len) {
+  if (output > 8) {
+    output = 0;
+  }
+  LuaConsole_refill(self, now_ms);
+  if (self->tokens[output] < 1000) {
+    self->dropped_rate++;
+    self->pending_dropped++;
+    return false;
+  }
+  uint8_t next = (self->head + 1) % LUACONSOLE_LINES;
+  if (next == self->tail) {
+    self->dropped_full++;
+    self->pending_dropped++;
+    return false;
+  }
+  self->tokens[output] -= 1000;
+  LuaConsoleLine *line = &self->lines[self->head];
+  if (len > LUACONSOLE_LINE_SIZE) {
+    len = LUACONSOLE_LINE_SIZE;
+  }
+  memcpy(line->text, text, len);
+  line->len = len;
+  line->output = output;
+  line->time_ms = now_ms;
+  line->dropped = self->pending_dropped;
+  self->pending_dropped = 0;
+  self->head = next;
+  self->printed++;
+  return true;
+}
+
+// LuaConsole_peek returns the oldest line, NULL if there is none.
+LuaConsoleLine *LuaConsole_peek(LuaConsole *self) {
+  if (self->head == self->tail) {
+    return NULL;
+  }
+  return &self->lines[self->tail];
+}
+
+void LuaConsole_pop(LuaConsole *self) {
+  if (self->head != self->tail) {
+    self->tail = (self->tail + 1) % LUACONSOLE_LINES;
+  }
+}
+
+#endif
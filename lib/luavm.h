@@ -22,9 +22,38 @@ int _unlink(const char *pathname) {
 #endif
 //
 #include "lua_globals.h"
+#include "luaconsole.h"
 
 lua_State *L = NULL;
 
+// print() from scripts lands here, tagged with the output running
+LuaConsole luaconsole;
+uint8_t lua_print_output = LUACONSOLE_REPL;
+
+// luaPrint replaces the standard print, formatting like it but into the
+// console ring instead of a blocking write to stdio
+static int luaPrint(lua_State *L) {
+  char line[LUACONSOLE_LINE_SIZE];
+  uint32_t len = 0;
+  int n = lua_gettop(L);
+  for (int i = 1; i <= n; i++) {
+    size_t l;
+    const char *s = luaL_tolstring(L, i, &l);
+    if (i > 1 && len < sizeof(line)) {
+      line[len++] = '\t';
+    }
+    if (l > sizeof(line) - len) {
+      l = sizeof(line) - len;
+    }
+    memcpy(&line[len], s, l);
+    len += l;
+    lua_pop(L, 1);
+  }
+  LuaConsole_push(&luaconsole, lua_print_output,
+                  to_ms_since_boot(get_absolute_time()), line, len);
+  return 0;
+}
+
 /**
 function update_env(i, code)
     envs[i] = new_env(code)
@@ -32,6 +61,7 @@ end
 **/
 int luaUpdateEnvironment(int index, const char *code) {
   printf("[luaUpdateEnvironment] index: %d, code: %s\n", index, code);
+  lua_print_output = LuaConsole_script_output(index);
   if (L == NULL) {
     printf("[luaUpdateEnvironment] Lua VM not initialized.\n");
     return 1;
@@ -62,6 +92,8 @@ int luaInit() {
   }
   L = luaL_newstate();  // Create a new Lua state
   luaL_openlibs(L);     // Open standard libraries
+  LuaConsole_init(&luaconsole);
+  lua_register(L, "print", luaPrint);
 
   // Load Lua script from embedded string
   if (luaL_loadbuffer(L, (const char *)globals_lua, globals_lua_len,
@@ -89,6 +121,7 @@ int luaInit() {
 bool Lua_eval_simple(const char*   script
                      , size_t      script_len
                      , const char* chunkname) {
+  lua_print_output = LUACONSOLE_REPL;
   if(luaL_loadbuffer(L, script, script_len, chunkname) != LUA_OK) {
     printf("Error loading Lua repl eval: %s\n", lua_tostring(L, -1));
     return false;
@@ -103,6 +136,7 @@ bool Lua_eval_simple(const char*   script
 }
 
 bool withLuaEnv(int index) {
+  lua_print_output = LuaConsole_script_output(index);
   lua_getglobal(L, "envs");   // Push envs onto the stack
   if (!lua_istable(L, -1)) {  // Check if envs is a table
     lua_pop(L, 1);            // Pop envs
@@ -29,79 +29,120 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "mcp3208.pio.h"
 #include "pico/stdlib.h"
 
+// The MCP3208 is scanned in the background: a PIO state machine runs each
+// conversion with its own chip select and two DMA channels loop over the
+// eight commands and the results of the last MCP3208_SCANS scans, so the
+// latest values of every channel are always in memory and reading a knob
+// is a few loads.
+//
+// A conversion is 24 clocks, the scan runs at about
+// MCP3208_BAUDRATE / 26 / 8 per second. MCP3208_read sums a channel over
+// the scans in the ring, 16 scans of 12 bits decimate to 14.
+
+#define MCP3208_BAUDRATE 1000000
+// at the scan rate the transfer counts last more than a day, MCP3208_read
+// re-arms them when they run out
+#define MCP3208_TRANSFERS 0xFFFFFFFF
+#define MCP3208_RING_BITS 5
+#define MCP3208_SCANS 16
+#define MCP3208_SCANS_RING_BITS 9
+// full scale of MCP3208_read
+#define MCP3208_MAX ((4095 * MCP3208_SCANS) >> 2)
+
 typedef struct MCP3208 {
+  // a conversion of each channel, top 24 bits shifted out
+  uint32_t commands[8] __attribute__((aligned(32)));
+  // last 24 bits received for each channel in each scan, written by dma
+  volatile uint32_t results[MCP3208_SCANS * 8] __attribute__((aligned(512)));
   uint8_t cs_pin;
   uint8_t sck_pin;
   uint8_t mosi_pin;
   uint8_t miso_pin;
-  spi_inst_t *spi;
-  uint8_t *buffer;
-  uint8_t *data;
+  PIO pio;
+  uint sm;
+  int tx_channel;
+  int rx_channel;
 } MCP3208;
 
-void MCP3208_init(MCP3208 *self, spi_inst_t *spi, uint8_t cs_pin,
+void MCP3208_start(MCP3208 *self) {
+  dma_channel_set_trans_count(self->rx_channel, MCP3208_TRANSFERS, true);
+  dma_channel_set_trans_count(self->tx_channel, MCP3208_TRANSFERS, true);
+}
+
+// MCP3208_init starts scanning. CS and SCK are driven as PIO side-set pins
+// and must be consecutive.
+void MCP3208_init(MCP3208 *self, PIO pio, uint sm, uint8_t cs_pin,
                   uint8_t sck_pin, uint8_t mosi_pin, uint8_t miso_pin) {
   self->cs_pin = cs_pin;
   self->sck_pin = sck_pin;
   self->mosi_pin = mosi_pin;
   self->miso_pin = miso_pin;
-  self->spi = spi;
-  self->buffer = (uint8_t *)malloc(3 * sizeof(uint8_t));
-  self->data = (uint8_t *)malloc(3 * sizeof(uint8_t));
-
-  self->buffer[0] = 0x01;  // Start bit default
-  self->buffer[2] = 0x00;  // Dummy byte
-
-  // Initialize CS pin high
-  gpio_init(self->cs_pin);
-  gpio_set_dir(self->cs_pin, GPIO_OUT);
-  gpio_put(self->cs_pin, 1);
-
-  // Initialize SPI port at 0.5 MHz
-  spi_init(spi, 1000 * 1000);
+  self->pio = pio;
+  self->sm = sm;
+  if (sck_pin != cs_pin + 1) {
+    printf("[mcp3208] sck must follow cs\n");
+    return;
+  }
+  for (uint8_t channel = 0; channel < 8; channel++) {
+    // the start bit goes as late as it can so all 12 bits of the result
+    // land in the last 12 clocks
+    self->commands[channel] =
+        ((0x06u | channel >> 2) << 24) | (((channel & 0x03u) << 6) << 16);
+  }
+  for (uint16_t i = 0; i < MCP3208_SCANS * 8; i++) {
+    self->results[i] = 0;
+  }
 
-  // Initialize SPI pins
-  gpio_set_function(self->sck_pin, GPIO_FUNC_SPI);
-  gpio_set_function(self->mosi_pin, GPIO_FUNC_SPI);
-  gpio_set_function(self->miso_pin, GPIO_FUNC_SPI);
+  uint offset = pio_add_program(pio, &mcp3208_program);
+  mcp3208_program_init(pio, sm, offset, cs_pin, mosi_pin, miso_pin,
+                       MCP3208_BAUDRATE);
+
+  // commands go round the ring into the state machine
+  self->tx_channel = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(self->tx_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_ring(&c, false, MCP3208_RING_BITS);
+  channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+  dma_channel_configure(self->tx_channel, &c, &pio->txf[sm], self->commands,
+                        MCP3208_TRANSFERS, false);
+
+  // and results come back round the other ring in the same order
+  self->rx_channel = dma_claim_unused_channel(true);
+  c = dma_channel_get_default_config(self->rx_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, MCP3208_SCANS_RING_BITS);
+  channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false));
+  dma_channel_configure(self->rx_channel, &c, self->results, &pio->rxf[sm],
+                        MCP3208_TRANSFERS, false);
+
+  MCP3208_start(self);
 }
 
-uint16_t MCP3208_read(MCP3208 *self, uint8_t channel, bool differential) {
-  uint16_t val = 0;
-
-  // Validate channel (0-7 for single-ended, 0-3 for differential)
-  if (channel > 7 || (differential && channel > 3)) {
+// MCP3208_read returns a channel averaged over the last scans, from 0 to
+// MCP3208_MAX.
+uint16_t MCP3208_read(MCP3208 *self, uint8_t channel) {
+  if (channel > 7) {
     printf("Invalid channel: %d\n", channel);
-    return 0xFFFF;  // Return error code for invalid channel
+    return 0xFFFF;
   }
-
-  // Construct SPI command
-  self->buffer[0] = 0x01;  // Start bit
-  self->buffer[1] = ((differential ? 0 : 1) << 7) | (channel << 4);
-  self->buffer[2] = 0x00;  // Dummy byte
-
-  // Assert CS
-  gpio_put(self->cs_pin, 0);
-
-  // Send command and read response
-  int num_bytes_wrote =
-      spi_write_read_blocking(self->spi, self->buffer, self->data, 3);
-
-  // Deassert CS
-  gpio_put(self->cs_pin, 1);
-
-  // Process response if SPI communication succeeded
-  if (num_bytes_wrote == 3) {
-    val = ((self->data[1] & 0x03) << 8) | self->data[2];
-  } else {
-    printf("SPI communication failed\n");
-    return 0xFFFF;  // Return error code for SPI failure
+  if (!dma_channel_is_busy(self->rx_channel)) {
+    // both rings finished their count together, go round again
+    MCP3208_start(self);
   }
-
-  return val;
+  uint32_t sum = 0;
+  for (uint8_t scan = 0; scan < MCP3208_SCANS; scan++) {
+    sum += self->results[scan * 8 + channel] & 0xFFF;
+  }
+  return sum >> 2;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,42 +1,201 @@
-
 #ifndef MCP4728_LIB
 #define MCP4728_LIB 1
 
 #include <stdio.h>
 
+#include "hardware/dma.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 
 #define MCP4728_ADDRESS 0x60
+// the MCP4728 does fast mode, the RP2040 cannot do its 3.4 MHz high speed
+// mode, so this is as fast as the bus goes
+#ifndef MCP4728_BAUDRATE
+#define MCP4728_BAUDRATE 400000
+#endif
+// a transfer that has not finished after this long is a stuck bus
+#define MCP4728_TIMEOUT_US 2000
+// consecutive errors before the i2c block is reset
+#define MCP4728_ERRORS_RESET 3
+
+// MCP4728_update sends the channels that changed with DMA and returns right
+// away. One or two channels go as multi-write commands (3 bytes each), more
+// than that as one fast write of all four (8 bytes).
+// The i2c interrupt catches the stop (or an abort) at the end of the
+// transfer, times it and calls on_done. An update asked for while a
+// transfer is running is sent from the interrupt as soon as it ends, so
+// the chip always ends up with the latest voltages.
 
-typedef struct MCP4728 {
+typedef struct MCP4728 MCP4728;
+typedef void (*MCP4728_callback)(MCP4728 *self, bool ok, void *user);
+
+struct MCP4728 {
   i2c_inst_t *i2c;
-  float voltage[4];
+  uint16_t code[4];
+  // channels whose code changed since they were last sent
+  volatile uint8_t dirty;
+  // channels in the transfer in progress
+  uint8_t sending;
   bool use_internal_ref;
   float voltage_reference;
   uint8_t address;
-} MCP4728;
+  // async transfers
+  uint dma_channel;
+  // up to a fast write of 4 channels
+  uint32_t cmd[8];
+  volatile bool busy;
+  volatile bool pending;
+  volatile uint32_t start_us;
+  volatile uint32_t transfer_us;
+  volatile uint32_t transfer_us_max;
+  volatile uint32_t transfers;
+  volatile uint32_t errors;
+  volatile uint8_t errors_in_row;
+  uint32_t resets;
+  MCP4728_callback on_done;
+  void *on_done_user;
+};
+
+// the MCP4728 on each i2c block, for the interrupt handlers
+MCP4728 *mcp4728_irq_instance[2] = {NULL, NULL};
 
 void MCP4728_write_address(MCP4728 *self, uint8_t address, uint8_t data) {
   uint8_t buf[2] = {address, data};
   i2c_write_blocking(self->i2c, self->address, buf, 2, false);
 }
 
+// MCP4728_start queues the write commands for the dirty channels and starts
+// the DMA feeding them to the i2c tx fifo.
+void MCP4728_start(MCP4728 *self) {
+  uint8_t dirty = self->dirty;
+  uint8_t count = (dirty & 1) + ((dirty >> 1) & 1) + ((dirty >> 2) & 1) +
+                  ((dirty >> 3) & 1);
+  uint8_t len = 0;
+  if (count <= 2) {
+    // multi-write, page 39, writes the input registers but not the eeprom
+    uint8_t config = self->use_internal_ref ? 0b10010000 : 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      if (dirty & (1 << i)) {
+        self->cmd[len++] = 0b01000000 | (i << 1);
+        self->cmd[len++] = config | (self->code[i] >> 8);
+        self->cmd[len++] = self->code[i] & 0xff;
+      }
+    }
+    self->sending = dirty;
+  } else {
+    // fast write, page 38
+    for (uint8_t i = 0; i < 4; i++) {
+      self->cmd[len++] = 0b00000000 | (self->code[i] >> 8);
+      self->cmd[len++] = self->code[i] & 0xff;
+    }
+    self->sending = 0x0F;
+  }
+  self->dirty &= ~self->sending;
+  self->cmd[len - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+  i2c_hw_t *hw = i2c_get_hw(self->i2c);
+  // drop interrupts left over from the blocking writes
+  (void)hw->clr_intr;
+  hw->intr_mask =
+      I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  self->busy = true;
+  self->pending = false;
+  self->start_us = time_us_32();
+  dma_channel_set_read_addr(self->dma_channel, self->cmd, false);
+  dma_channel_set_trans_count(self->dma_channel, len, true);
+}
+
+void MCP4728_irq(MCP4728 *self) {
+  i2c_hw_t *hw = i2c_get_hw(self->i2c);
+  uint32_t status = hw->raw_intr_stat;
+  bool ok = true;
+  if (status & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+    // a nack or lost arbitration, the block flushes its fifo and the rest
+    // of the dma transfer has nowhere to go
+    dma_channel_abort(self->dma_channel);
+    (void)hw->clr_tx_abrt;
+    ok = false;
+  } else if (!(status & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+    return;
+  }
+  (void)hw->clr_stop_det;
+  hw->intr_mask = 0;
+  self->transfer_us = time_us_32() - self->start_us;
+  if (self->transfer_us > self->transfer_us_max) {
+    self->transfer_us_max = self->transfer_us;
+  }
+  self->transfers++;
+  if (ok) {
+    self->errors_in_row = 0;
+  } else {
+    // send them again
+    self->dirty |= self->sending;
+    self->pending = true;
+    self->errors++;
+    self->errors_in_row++;
+  }
+  self->busy = false;
+  if (self->on_done != NULL) {
+    self->on_done(self, ok, self->on_done_user);
+  }
+  if (self->pending && self->dirty != 0 &&
+      self->errors_in_row < MCP4728_ERRORS_RESET) {
+    MCP4728_start(self);
+  }
+}
+
+void MCP4728_irq0() { MCP4728_irq(mcp4728_irq_instance[0]); }
+
+void MCP4728_irq1() { MCP4728_irq(mcp4728_irq_instance[1]); }
+
+// MCP4728_recover resets the i2c block after a stuck transfer or repeated
+// errors, which also releases a bus held by a half finished transfer.
+void MCP4728_recover(MCP4728 *self) {
+  uint irq_num = i2c_hw_index(self->i2c) == 0 ? I2C0_IRQ : I2C1_IRQ;
+  irq_set_enabled(irq_num, false);
+  dma_channel_abort(self->dma_channel);
+  i2c_init(self->i2c, MCP4728_BAUDRATE);
+  i2c_get_hw(self->i2c)->enable = 0;
+  i2c_get_hw(self->i2c)->tar = self->address;
+  i2c_get_hw(self->i2c)->enable = 1;
+  self->busy = false;
+  self->dirty = 0x0F;
+  self->errors_in_row = 0;
+  self->resets++;
+  irq_set_enabled(irq_num, true);
+}
+
+// MCP4728_update sends the dirty channels without waiting for the bus.
 void MCP4728_update(MCP4728 *self) {
-  // page 38 http://ww1.microchip.com/downloads/en/devicedoc/22187e.pdf
-  uint8_t data[8];
-  for (int i = 0; i < 4; i++) {
-    uint16_t value =
-        (uint16_t)round(self->voltage[i] * 4095.0 / self->voltage_reference);
-    // printf("voltage[%d] = %f (%d)\n", i, self->voltage[i], value);
-    data[i * 2] = 0b00000000 | (value >> 8);
-    data[i * 2 + 1] = value & 0xff;
+  if (self->busy && time_us_32() - self->start_us > MCP4728_TIMEOUT_US) {
+    self->errors++;
+    MCP4728_recover(self);
+  } else if (self->errors_in_row >= MCP4728_ERRORS_RESET) {
+    MCP4728_recover(self);
+  }
+  // the i2c interrupt clears busy and may start a transfer itself
+  uint32_t status = save_and_disable_interrupts();
+  if (self->busy) {
+    self->pending = true;
+  } else if (self->dirty != 0) {
+    MCP4728_start(self);
   }
-  uint8_t ret = i2c_write_blocking(self->i2c, self->address, data, 8, false);
-  if (ret == PICO_ERROR_GENERIC) {
-    printf("Error writing to MCP4728\n");
+  restore_interrupts(status);
+}
+
+// MCP4728_wait blocks until the transfer in progress has finished.
+void MCP4728_wait(MCP4728 *self) {
+  while (self->busy && time_us_32() - self->start_us <= MCP4728_TIMEOUT_US) {
+    tight_loop_contents();
   }
 }
 
+void MCP4728_set_callback(MCP4728 *self, MCP4728_callback on_done,
+                          void *user) {
+  self->on_done = on_done;
+  self->on_done_user = user;
+}
+
 void MCP4728_init(MCP4728 *self, i2c_inst_t *i2c, bool use_internal_ref,
                   float external_voltage) {
   self->i2c = i2c;
@@ -71,14 +230,54 @@ void MCP4728_init(MCP4728 *self, i2c_inst_t *i2c, bool use_internal_ref,
     }
   }
   for (int i = 0; i < 4; i++) {
-    self->voltage[i] = 0;
+    self->code[i] = 0;
   }
+  self->dirty = 0x0F;
+
+  // the blocking writes above left the target address set, from here on
+  // the dma feeds the tx fifo and the interrupt ends each transfer
+  self->busy = false;
+  self->pending = false;
+  self->transfer_us = 0;
+  self->transfer_us_max = 0;
+  self->transfers = 0;
+  self->errors = 0;
+  self->errors_in_row = 0;
+  self->resets = 0;
+  self->on_done = NULL;
+  self->on_done_user = NULL;
+  self->dma_channel = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(self->dma_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, i2c_get_dreq(self->i2c, true));
+  dma_channel_configure(self->dma_channel, &c, &i2c_get_hw(self->i2c)->data_cmd,
+                        self->cmd, 8, false);
+  uint index = i2c_hw_index(self->i2c);
+  mcp4728_irq_instance[index] = self;
+  irq_set_exclusive_handler(index == 0 ? I2C0_IRQ : I2C1_IRQ,
+                            index == 0 ? MCP4728_irq0 : MCP4728_irq1);
+  irq_set_enabled(index == 0 ? I2C0_IRQ : I2C1_IRQ, true);
 
   MCP4728_update(self);
 }
 
+// MCP4728_set_code sets the 12-bit code of a channel, marking it dirty if it
+// changed.
+void MCP4728_set_code(MCP4728 *self, uint8_t ch, uint16_t code) {
+  if (self->code[ch] != code) {
+    // dirty is also changed from the i2c and fast dac interrupts
+    uint32_t status = save_and_disable_interrupts();
+    self->code[ch] = code;
+    self->dirty |= 1 << ch;
+    restore_interrupts(status);
+  }
+}
+
 void MCP4728_set_voltage(MCP4728 *self, uint8_t ch, float voltage) {
-  self->voltage[ch] = voltage;
+  MCP4728_set_code(self, ch,
+                   (uint16_t)round(voltage * 4095.0 / self->voltage_reference));
 }
 
 #endif
\ No newline at end of file
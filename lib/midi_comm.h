@@ -14,123 +14,257 @@ typedef void (*callback_uint8_buffer)(uint8_t *buffer, int length);
 typedef void (*callback_void)();
 
 
-uint32_t send_buffer_as_sysex(char *buffer, uint32_t bufsize) {
-  uint8_t sysex_data[bufsize + 2];  // +2 for SysEx start and end bytes
+// Outgoing MIDI never blocks the caller. SysEx and channel messages are
+// queued whole into a ring buffer and midi_tx_task streams them to TinyUSB
+// in bounded slices from the main loop. Real-time bytes (clock, start,
+// stop) skip the queue as single USB-MIDI packets, which may sit between
+// the packets of a SysEx that is still being streamed.
 
-  sysex_data[0] = 0xF0;  // Start of SysEx
-  for (uint32_t i = 0; i < bufsize; i++) {
-    sysex_data[i + 1] = buffer[i];  // Copy buffer into SysEx data
-  }
-  sysex_data[bufsize + 1] = 0xF7;  // End of SysEx
+#define MIDI_TX_BUFFER_SIZE 4096
+// bytes handed to TinyUSB per midi_tx_task call
+#define MIDI_TX_SLICE 48
+#define MIDI_TX_PRINTF_SIZE 256
 
-  uint32_t v = tud_midi_n_stream_write(0, 0, sysex_data, sizeof(sysex_data));
-  tud_task();
-  return v;
+uint8_t midi_tx_buffer[MIDI_TX_BUFFER_SIZE];
+uint16_t midi_tx_head = 0;  // next byte to write
+uint16_t midi_tx_tail = 0;  // next byte to send
+uint16_t midi_tx_high_water = 0;
+uint32_t midi_tx_dropped = 0;
+uint32_t midi_tx_dropped_realtime = 0;
+char midi_tx_printf_buffer[MIDI_TX_PRINTF_SIZE];
+
+uint16_t midi_tx_used() {
+  return (midi_tx_head - midi_tx_tail) & (MIDI_TX_BUFFER_SIZE - 1);
 }
 
-uint32_t send_text_as_sysex(const char *text) {
-  while (!tud_ready()) {
-    tud_task();
-  }
-  uint32_t text_length = strlen(text);  // Get the length of the text
-  uint8_t sysex_data[text_length + 2];  // +2 for SysEx start and end bytes
+// midi_tx_free is the room left for queued messages, one slot is kept empty
+// to tell full from empty
+uint16_t midi_tx_free() { return MIDI_TX_BUFFER_SIZE - 1 - midi_tx_used(); }
 
-  sysex_data[0] = 0xF0;  // Start of SysEx
-  for (uint32_t i = 0; i < text_length; i++) {
-    sysex_data[i + 1] = text[i];  // Copy text into SysEx data
+void midi_tx_push(const uint8_t *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    midi_tx_buffer[midi_tx_head] = data[i];
+    midi_tx_head = (midi_tx_head + 1) & (MIDI_TX_BUFFER_SIZE - 1);
+  }
+  if (midi_tx_used() > midi_tx_high_water) {
+    midi_tx_high_water = midi_tx_used();
   }
-  sysex_data[text_length + 1] = 0xF7;  // End of SysEx
+}
 
-  // Call the stream write function with the SysEx message
-  uint32_t v = tud_midi_n_stream_write(0, 0, sysex_data, sizeof(sysex_data));
-  tud_task();
-  return v;
+// midi_tx_enqueue_sysex queues F0 <data> F7. Returns false (and counts a
+// drop) when the queue cannot take the whole message.
+bool midi_tx_enqueue_sysex(const uint8_t *data, uint32_t len) {
+  if (len + 2 > midi_tx_free()) {
+    midi_tx_dropped++;
+    return false;
+  }
+  const uint8_t start = 0xF0;
+  const uint8_t end = 0xF7;
+  midi_tx_push(&start, 1);
+  midi_tx_push(data, len);
+  midi_tx_push(&end, 1);
+  return true;
 }
 
-void send_midi_clock() {
-  // Ensure TinyUSB stack is initialized and ready
-  if (tud_ready()) {
-    // Construct the MIDI message
-    // MIDI Timing Clock message format: 0xF8
-    uint8_t midi_message[1];
-    midi_message[0] = 0xF8;  // Timing Clock command
+bool midi_tx_enqueue(const uint8_t *data, uint32_t len) {
+  if (len > midi_tx_free()) {
+    midi_tx_dropped++;
+    return false;
+  }
+  midi_tx_push(data, len);
+  return true;
+}
 
-    // Send the MIDI message
-    tud_midi_n_stream_write(0, 0, midi_message, sizeof(midi_message));
-    tud_task();
+// midi_tx_realtime sends a single real-time byte as its own packet.
+bool midi_tx_realtime(uint8_t status) {
+  if (!tud_ready()) {
+    return false;
   }
+  uint8_t packet[4] = {MIDI_CIN_1BYTE_DATA, status, 0, 0};
+  if (!tud_midi_n_packet_write(0, packet)) {
+    midi_tx_dropped_realtime++;
+    return false;
+  }
+  return true;
 }
 
-void send_midi_start() {
-  // Ensure TinyUSB stack is initialized and ready
-  if (tud_ready()) {
-    // Construct the MIDI message
-    // MIDI Start message format: 0xFA
-    uint8_t midi_message[1];
-    midi_message[0] = 0xFA;  // Start command
+// midi_tx_task hands at most MIDI_TX_SLICE queued bytes to TinyUSB. Returns
+// the number of bytes still waiting.
+uint16_t midi_tx_task() {
+  if (midi_tx_head == midi_tx_tail) {
+    return 0;
+  }
+  if (!tud_ready()) {
+    return midi_tx_used();
+  }
+  uint16_t budget = MIDI_TX_SLICE;
+  while (budget > 0 && midi_tx_head != midi_tx_tail) {
+    // contiguous run up to the end of the buffer
+    uint16_t run = midi_tx_head > midi_tx_tail
+                       ? midi_tx_head - midi_tx_tail
+                       : MIDI_TX_BUFFER_SIZE - midi_tx_tail;
+    if (run > budget) {
+      run = budget;
+    }
+    uint32_t written =
+        tud_midi_n_stream_write(0, 0, &midi_tx_buffer[midi_tx_tail], run);
+    midi_tx_tail = (midi_tx_tail + written) & (MIDI_TX_BUFFER_SIZE - 1);
+    budget -= written;
+    if (written < run) {
+      // usb fifo is full, try again next pass
+      break;
+    }
+  }
+  return midi_tx_used();
+}
 
-    // Send the MIDI message
-    tud_midi_n_stream_write(0, 0, midi_message, sizeof(midi_message));
+// midi_tx_drain blocks until the queue is empty or timeout_ms passes. Only
+// for paths that are about to reset or otherwise stop the main loop.
+bool midi_tx_drain(uint32_t timeout_ms) {
+  uint32_t start = to_ms_since_boot(get_absolute_time());
+  while (midi_tx_task() > 0) {
     tud_task();
+    if (to_ms_since_boot(get_absolute_time()) - start > timeout_ms) {
+      return false;
+    }
   }
+  tud_task();
+  return true;
 }
 
-void send_midi_stop() {
-  // Ensure TinyUSB stack is initialized and ready
-  if (tud_ready()) {
-    // Construct the MIDI message
-    // MIDI Stop message format: 0xFC
-    uint8_t midi_message[1];
-    midi_message[0] = 0xFC;  // Stop command
-
-    // Send the MIDI message
-    tud_midi_n_stream_write(0, 0, midi_message, sizeof(midi_message));
-    tud_task();
+uint32_t send_buffer_as_sysex(char *buffer, uint32_t bufsize) {
+  if (!tud_ready()) {
+    // nobody is listening, do not fill the queue with stale replies
+    return 0;
+  }
+  if (!midi_tx_enqueue_sysex((const uint8_t *)buffer, bufsize)) {
+    return 0;
   }
+  return bufsize + 2;
 }
 
-void send_midi_note_on(uint8_t note, uint8_t velocity) {
-  // Ensure TinyUSB stack is initialized and ready
-  if (tud_ready()) {
-    // MIDI cable number 0, Note On event, channel 1
-    uint8_t channel = 0;  // MIDI channels are 0-15
+uint32_t send_text_as_sysex(const char *text) {
+  return send_buffer_as_sysex((char *)text, strlen(text));
+}
 
-    // Construct the MIDI message
-    // MIDI Note On message format: 0x9n, where n is the channel number
-    uint8_t midi_message[3];
-    midi_message[0] = 0x90 | channel;  // Note On command with channel
-    midi_message[1] = note;            // MIDI note number
-    midi_message[2] = velocity;        // Note velocity
+void send_midi_clock() { midi_tx_realtime(0xF8); }
 
-    // Send the MIDI message
-    tud_midi_n_stream_write(0, 0, midi_message, sizeof(midi_message));
-    tud_task();
-  }
+void send_midi_start() { midi_tx_realtime(0xFA); }
+
+void send_midi_stop() { midi_tx_realtime(0xFC); }
+
+void send_midi_note_on(uint8_t note, uint8_t velocity) {
+  // MIDI channels are 0-15, always channel 1
+  uint8_t channel = 0;
+  uint8_t midi_message[3] = {0x90 | channel, note, velocity};
+  midi_tx_enqueue(midi_message, sizeof(midi_message));
 }
 
+// printf_sysex formats once into a static buffer, longer text is truncated
 int printf_sysex(const char *format, ...) {
-  if (!tud_ready()) {
-    return 0;
-  }
   va_list args;
   va_start(args, format);
-  int text_length = vsnprintf(NULL, 0, format, args);
-  va_end(args);
-
-  char text[text_length + 1];  // +1 for null terminator
-  va_start(args, format);
-  vsnprintf(text, text_length + 1, format, args);
+  int text_length = vsnprintf(midi_tx_printf_buffer, MIDI_TX_PRINTF_SIZE,
+                              format, args);
   va_end(args);
-
-  return send_text_as_sysex(text);
+  if (text_length < 0) {
+    return 0;
+  }
+  if (text_length >= MIDI_TX_PRINTF_SIZE) {
+    text_length = MIDI_TX_PRINTF_SIZE - 1;
+  }
+  return send_buffer_as_sysex(midi_tx_printf_buffer, text_length);
 }
 
 typedef void (*midi_comm_callback)(uint8_t, uint8_t, uint8_t, uint8_t);
 
+// Incoming SysEx is assembled in place into one of MIDI_SYSEX_SLOTS
+// buffers and handed to the callback as (pointer, length), nul terminated
+// for the text parsers. The next message starts in the other slot, so a
+// handler may hold on to its pointer until another message completes.
+#define MIDI_SYSEX_SIZE 1024
+#define MIDI_SYSEX_SLOTS 2
+// extra 3-byte reads per midi_comm_task call while a SysEx is open
+#define MIDI_SYSEX_READS_PER_TASK 32
+
 uint8_t midi_buffer[32];
-uint8_t midi_sysex_buffer[1024];
+uint8_t midi_sysex_buffer[MIDI_SYSEX_SLOTS][MIDI_SYSEX_SIZE + 1];
+uint8_t midi_sysex_slot = 0;
 bool midi_sysex_active = false;
-uint8_t midi_sysex_index = 0;
+uint16_t midi_sysex_index = 0;
+uint32_t midi_sysex_overflows = 0;
+
+// midi_realtime dispatches a real-time byte, returns false for other bytes
+bool midi_realtime(uint8_t b, callback_void midi_start,
+                   callback_void midi_continue, callback_void midi_stop,
+                   callback_void midi_timing) {
+  callback_void callback;
+  if (b == 0xf8) {
+    callback = midi_timing;
+  } else if (b == 0xfa) {
+    callback = midi_start;
+  } else if (b == 0xfb) {
+    callback = midi_continue;
+  } else if (b == 0xfc) {
+    callback = midi_stop;
+  } else {
+    return false;
+  }
+  usb_midi_present = true;
+  if (callback != NULL) {
+    callback();
+  }
+  return true;
+}
+
+// midi_sysex_feed takes bytes from the stream and calls sysex_callback for
+// each completed message. Real-time bytes inside a SysEx are dispatched
+// straight away and left out of the message. Returns true if any of the
+// bytes belonged to a SysEx.
+bool midi_sysex_feed(callback_uint8_buffer sysex_callback, uint8_t *data,
+                     uint32_t len, callback_void midi_start,
+                     callback_void midi_continue, callback_void midi_stop,
+                     callback_void midi_timing) {
+  bool consumed = false;
+  for (uint32_t i = 0; i < len; i++) {
+    uint8_t b = data[i];
+    if (midi_sysex_active || b == 0xF0 || b == 0xF7) {
+      consumed = true;
+    }
+    if (b == 0xF0) {
+      // Start of SysEx, an unterminated message is discarded
+      midi_sysex_active = true;
+      midi_sysex_index = 0;
+    } else if (b == 0xF7) {
+      // End of SysEx
+      if (midi_sysex_active && midi_sysex_index > 0) {
+        uint8_t *message = midi_sysex_buffer[midi_sysex_slot];
+        message[midi_sysex_index] = 0;
+        midi_sysex_slot = (midi_sysex_slot + 1) % MIDI_SYSEX_SLOTS;
+        if (sysex_callback != NULL) {
+          sysex_callback(message, midi_sysex_index);
+        }
+      }
+      midi_sysex_active = false;
+      midi_sysex_index = 0;
+    } else if (midi_sysex_active) {
+      if (b >= 0xF8) {
+        // real-time bytes may appear inside a SysEx, they are not data
+        midi_realtime(b, midi_start, midi_continue, midi_stop, midi_timing);
+        continue;
+      }
+      if (midi_sysex_index < MIDI_SYSEX_SIZE) {
+        midi_sysex_buffer[midi_sysex_slot][midi_sysex_index++] = b;
+      } else {
+        // Buffer overflow, drop the rest of this message
+        midi_sysex_active = false;
+        midi_sysex_index = 0;
+        midi_sysex_overflows++;
+      }
+    }
+  }
+  return consumed;
+}
 
 void midi_comm_task(callback_uint8_buffer sysex_callback,
                     callback_int_int_int midi_note_on,
@@ -141,7 +275,8 @@ void midi_comm_task(callback_uint8_buffer sysex_callback,
                     callback_int_int midi_channel_pressure_callback,  // 0xd0
                     callback_int_int midi_pitch_bend_callback,        // 0xe0
                     callback_void midi_start, callback_void midi_continue,
-                    callback_void midi_stop, callback_void midi_timing) {
+                    callback_void midi_stop, callback_void midi_timing,
+                    callback_uint16 midi_song_position) {
   uint32_t bytes_read = 0;
   if (tud_midi_n_available(0, 0)) {
     bytes_read = tud_midi_n_stream_read(0, 0, midi_buffer, 3);
@@ -155,36 +290,23 @@ void midi_comm_task(callback_uint8_buffer sysex_callback,
   //   printf_sysex("[%d]: %x\n", i, midi_buffer[i]);
   // }
 
-  for (int i = 0; i < bytes_read; i++) {
-    if (midi_buffer[i] == 0xF0) {
-      // Start of SysEx
-      midi_sysex_active = true;
-      midi_sysex_index = 0;
-    } else if (midi_buffer[i] == 0xF7) {
-      // End of SysEx
-      if (midi_sysex_active && midi_sysex_index > 0) {
-        midi_sysex_active = false;
-        if (sysex_callback != NULL) {
-          // Call the callback with the completed SysEx message
-          sysex_callback(midi_sysex_buffer, midi_sysex_index);
-        }
-      }
-      // Reset the SysEx buffer
-      midi_sysex_index = 0;
-      memset(midi_sysex_buffer, 0, sizeof(midi_sysex_buffer));
-    } else if (midi_sysex_active) {
-      // Append to the SysEx buffer
-      if (midi_sysex_index < sizeof(midi_sysex_buffer)) {
-        midi_sysex_buffer[midi_sysex_index++] = midi_buffer[i];
-      } else {
-        // Buffer overflow, reset
-        midi_sysex_active = false;
-        midi_sysex_index = 0;
-        memset(midi_sysex_buffer, 0, sizeof(midi_sysex_buffer));
-      }
+  bool in_sysex =
+      midi_sysex_feed(sysex_callback, midi_buffer, bytes_read, midi_start,
+                      midi_continue, midi_stop, midi_timing);
+  // keep reading while a SysEx is open so uploads are not paced by the loop
+  for (uint8_t reads = 0; midi_sysex_active &&
+                          reads < MIDI_SYSEX_READS_PER_TASK &&
+                          tud_midi_n_available(0, 0);
+       reads++) {
+    bytes_read = tud_midi_n_stream_read(0, 0, midi_buffer, 3);
+    if (bytes_read == 0) {
+      break;
     }
+    midi_sysex_feed(sysex_callback, midi_buffer, bytes_read, midi_start,
+                    midi_continue, midi_stop, midi_timing);
   }
-  if (midi_sysex_active) {
+  if (in_sysex) {
+    // real-time bytes among these were dispatched by midi_sysex_feed
     return;
   }
 
@@ -219,6 +341,13 @@ void midi_comm_task(callback_uint8_buffer sysex_callback,
       midi_stop();
     }
     return;
+  } else if (midi_buffer[0] == 0xf2 && bytes_read > 2) {
+    // song position pointer, 14-bit count of midi beats
+    usb_midi_present = true;
+    if (midi_song_position != NULL) {
+      midi_song_position((midi_buffer[2] << 7) | midi_buffer[1]);
+    }
+    return;
   } else if (messageType == 0xa0 && bytes_read > 2) {
     // key pressure
     usb_midi_present = true;
@@ -285,6 +414,7 @@ void midi_comm_task(callback_uint8_buffer sysex_callback,
     uint8_t velocity = midi_buffer[2];
     if (messageType == 176 && channel == 0 && note == 0) {
       send_text_as_sysex("command=reset");
+      midi_tx_drain(100);
       sleep_ms(10);
       reset_usb_boot(0, 0);
     }
@@ -155,6 +155,19 @@ void midi_sysex_callback(uint8_t *sysex, int length) {
   float val;
   float val2;
   int vali;
+  if (get_sysex_param_float_value("storage", sysex, length, &val)) {
+    // storage1 exposes the sd card over usb, storage0 takes it back
+    MscDisk_request(&mscdisk, val >= 0.5f);
+    return;
+  }
+  if (mscdisk.active) {
+    // the host owns the card, nothing here may touch the filesystem
+    return;
+  }
+  if (SysExBin_is_frame(sysex, length)) {
+    Yoctocore_process_sysexbin(&yocto, sysex, length);
+    return;
+  }
   // check if sysex starts with LN (lua new)
   if (sysex[0] == 'L' &&
       (sysex[1] == 'A' || sysex[1] == 'N' || sysex[1] == 'E')) {
@@ -166,7 +179,38 @@ void midi_sysex_callback(uint8_t *sysex, int length) {
                        (sysex[1] == 'A' || sysex[1] == 'E'), sysex[1] == 'E');
   } else if (get_sysex_param_float_value("version", sysex, length, &val)) {
     printf_sysex("v1.0.0");
+  } else if (get_sysex_param_float_value("clockstat", sysex, length, &val)) {
+    // clockstat1 -> clock <bpm> <locked> <tick> <error_us> <jitter_us>
+    printf_sysex("clock %2.2f %d %" PRId32 " %d %d\n", MidiClock_bpm(&midiclock),
+                 midiclock.locked, midiclock.tick, (int)midiclock.error_us,
+                 (int)midiclock.jitter_us);
+  } else if (get_sysex_param_float_value("txstat", sysex, length, &val)) {
+    // txstat1 -> tx <queued> <free> <high_water> <dropped> <dropped_realtime>
+    printf_sysex("tx %d %d %d %" PRIu32 " %" PRIu32 "\n", midi_tx_used(),
+                 midi_tx_free(), midi_tx_high_water, midi_tx_dropped,
+                 midi_tx_dropped_realtime);
+  } else if (get_sysex_param_float_value("clockmaster", sysex, length,
+                                         &val)) {
+    // clockmaster1 leads with the internal clock, clockmaster0 follows
+    bool was_master = clockout.enabled;
+    yocto.clock_master = val >= 0.5f;
+    MidiClockOut_enable(&clockout, yocto.clock_master);
+    if (was_master && !yocto.clock_master) {
+      // the stop queued for downstream must not hold the outputs here
+      MidiClock_release(&midiclock);
+    }
+    if (yocto.clock_master) {
+      MidiClockOut_set_bpm(&clockout, yocto.global_tempo);
+      MidiClockOut_start(&clockout);
+    }
+    Yoctocore_schedule_save(&yocto);
+  } else if (get_sysex_param_float_value("tempo", sysex, length, &val)) {
+    // global tempo, only meaningful when not following a clock
+    if (val >= MIDICLOCKOUT_BPM_MIN && val <= MIDICLOCKOUT_BPM_MAX) {
+      set_global_tempo(val);
+    }
   } else if (get_sysex_param_float_value("diskmode", sysex, length, &val)) {
+    midi_tx_drain(100);
     sleep_ms(10);
     reset_usb_boot(0, 0);
   } else if (get_sysex_param_int_float_values("setvolt", sysex, length, &vali,
@@ -182,15 +226,87 @@ void midi_sysex_callback(uint8_t *sysex, int length) {
     if (yocto.out[output].voltage_do_override) {
       yocto.out[output].voltage_override = val;
     }
+  } else if (get_sysex_param_int_float_values("fastdac", sysex, length, &vali,
+                                              &val)) {
+    // fastdac_<output mask>_<rate hz> runs the envelopes and lfos of those
+    // outputs at the fast rate, fastdac_0_0 goes back to 250 Hz
+    FastDac_start(&fastdac, vali & 0xFF, (uint32_t)val);
+    printf_sysex("fastdac %d %" PRIu32 "\n", fastdac.mask, fastdac.rate_hz);
+  } else if (get_sysex_param_float_value("faststat", sysex, length, &val)) {
+    // faststat1 -> fast <mask> <rate> <tick us> <tick us max> <overruns>
+    //              <dac update us> <dac update us max>
+    printf_sysex("fast %d %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32
+                 " %" PRIu32 " %" PRIu32 "\n",
+                 fastdac.mask, fastdac.rate_hz, fastdac.tick_us,
+                 fastdac.tick_us_max, fastdac.overruns, dac.update_us,
+                 dac.update_us_max);
+  } else if (get_sysex_param_float_value("fastbench", sysex, length, &val)) {
+    // fastbench1 -> one line per number of outputs
+    //   fastbench <outputs> <cpu us> <bus us> <max rate hz>
+    uint8_t mask = fastdac.mask;
+    uint32_t rate = fastdac.rate_hz;
+    FastDac_stop(&fastdac);
+    for (uint8_t n = 1; n <= 8; n++) {
+      uint32_t cpu_us;
+      uint32_t bus_us;
+      FastDac_benchmark(&dac, n, &cpu_us, &bus_us);
+      uint32_t slowest = cpu_us > bus_us ? cpu_us : bus_us;
+      printf_sysex("fastbench %d %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", n,
+                   cpu_us, bus_us, slowest > 0 ? 1000000 / slowest : 0);
+    }
+    FastDac_start(&fastdac, mask, rate);
+  } else if (get_sysex_param_int_value("dither", sysex, length, &vali)) {
+    // dither<output mask> alternates DAC codes on those outputs while they
+    // are in note mode or quantized, so held pitches average to the exact
+    // voltage between two DAC steps
+    yocto.dither = vali & 0xFF;
+    Yoctocore_schedule_save(&yocto);
   } else if (get_sysex_param_float_value("useraw", sysex, length, &val)) {
     for (uint8_t i = 0; i < 8; i++) {
-      dac.use_raw[i] = val >= 0.5f;
+      DAC_set_raw(&dac, i, val >= 0.5f);
     }
     if (val >= 0.5f) {
       printf("using raw\n");
     } else {
       printf("using calibrated\n");
     }
+  } else if (get_sysex_param_int_and_two_float_values("calpt", sysex, length,
+                                                      &vali, &val, &val2)) {
+    // calpt_<output>_<raw volts>_<measured volts> stages a point of the
+    // calibration table of an output (1-index), measured with useraw1 at
+    // each whole volt from -5 to 10
+    int8_t output = vali - 1;
+    int point = (int)lroundf(val) - DACCODE_POINT_MIN;
+    if (output < 0 || output >= 8 || point < 0 || point >= DACCODE_POINTS) {
+      return;
+    }
+    yocto.calibration_staged[output][point] = val2;
+  } else if (get_sysex_param_int_value("calset", sysex, length, &vali)) {
+    // calset<output> saves and applies the staged table of an output
+    int8_t output = vali - 1;
+    if (output < 0 || output >= 8) {
+      return;
+    }
+    bool ok = Yoctocore_set_calibration_points(
+        &yocto, output, yocto.calibration_staged[output]);
+    if (ok) {
+      apply_calibration(output);
+    }
+    printf_sysex("calset %d %d\n", vali, ok);
+  } else if (get_sysex_param_int_value("calget", sysex, length, &vali)) {
+    // calget<output> -> caltable <output> <has table>, then a calpt line per
+    // point when it has one
+    int8_t output = vali - 1;
+    if (output < 0 || output >= 8) {
+      return;
+    }
+    printf_sysex("caltable %d %d\n", vali, yocto.out[output].calibration_table);
+    if (yocto.out[output].calibration_table) {
+      for (uint8_t k = 0; k < DACCODE_POINTS; k++) {
+        printf_sysex("calpt %d %d %f\n", vali, DACCODE_POINT_MIN + k,
+                     yocto.out[output].calibration_points[k]);
+      }
+    }
   } else if (get_sysex_param_int_and_two_float_values("cali", sysex, length,
                                                       &vali, &val, &val2)) {
     // expects 1-index
@@ -209,8 +325,7 @@ void midi_sysex_callback(uint8_t *sysex, int length) {
     } else {
       // set calibration
       if (Yoctocore_set_calibration(&yocto, output, val, val2)) {
-        dac.voltage_calibration_slope[output] = val;
-        dac.voltage_calibration_intercept[output] = val2;
+        apply_calibration(output);
       }
     }
   } else {
@@ -219,21 +334,60 @@ void midi_sysex_callback(uint8_t *sysex, int length) {
   }
 }
 
+// midi_clock_reset_outputs restarts clocks following the global tempo so the
+// first tick after start lands on a rising edge
+void midi_clock_reset_outputs() {
+  uint32_t ct = to_ms_since_boot(get_absolute_time());
+  for (uint8_t i = 0; i < 8; i++) {
+    Config *config = &yocto.config[yocto.i][i];
+    if ((config->mode == MODE_CLOCK || config->mode == MODE_CODE) &&
+        config->clock_tempo == 0) {
+      SimpleTimer_start(&pool_timer[i]);
+      SimpleTimer_reset(&pool_timer[i], ct);
+    }
+  }
+}
+
 void midi_start() {
+  if (clockout.enabled) {
+    // leading, ignore incoming transport
+    return;
+  }
 #ifdef DEBUG_MIDI
   printf("[midicallback] midi start\n");
 #endif
+  MidiClock_start(&midiclock);
+  midi_clock_reset_outputs();
 }
 void midi_continue() {
+  if (clockout.enabled) {
+    // leading, ignore incoming transport
+    return;
+  }
 #ifdef DEBUG_MIDI
-  printf("[midicallback] midi continue (starting)\n");
+  printf("[midicallback] midi continue\n");
 #endif
-  midi_start();
+  MidiClock_continue(&midiclock);
 }
 void midi_stop() {
+  if (clockout.enabled) {
+    // leading, ignore incoming transport
+    return;
+  }
 #ifdef DEBUG_MIDI
   printf("[midicallback] midi stop\n");
 #endif
+  MidiClock_stop(&midiclock);
+}
+void midi_song_position(uint16_t position) {
+  if (clockout.enabled) {
+    // leading, ignore incoming transport
+    return;
+  }
+#ifdef DEBUG_MIDI
+  printf("[midicallback] song position %d\n", position);
+#endif
+  MidiClock_song_position(&midiclock, position);
 }
 
 #endif
\ No newline at end of file
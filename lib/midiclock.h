@@ -0,0 +1,219 @@
+#ifndef LIB_MIDICLOCK_H
+#define LIB_MIDICLOCK_H 1
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// MidiClock follows an incoming 24 PPQN clock with a second-order
+// phase-locked loop: every 0xF8 is compared against the predicted tick time,
+// the prediction is nudged by a fraction of the error (phase) and the period
+// estimate absorbs a smaller fraction (frequency). The filtered tick times
+// are what outputs lock to, so USB jitter does not show up on the jacks.
+
+#define MIDICLOCK_PPQN 24
+// loop gains, stable for 0 < KI < KP < 1
+#define MIDICLOCK_KP 0.25f
+#define MIDICLOCK_KI 0.02f
+// errors larger than this many periods resync instead of slewing
+#define MIDICLOCK_RESYNC_PERIODS 4.0f
+// ticks with the error below MIDICLOCK_LOCK_ERROR before reporting lock
+#define MIDICLOCK_LOCK_TICKS 24
+#define MIDICLOCK_LOCK_ERROR 0.1f
+// tempo range accepted from the host
+#define MIDICLOCK_BPM_MIN 20.0f
+#define MIDICLOCK_BPM_MAX 400.0f
+
+typedef struct MidiClock {
+  // filtered tick period in microseconds
+  float period_us;
+  // predicted time of the next tick
+  uint64_t next_us;
+  // raw arrival time of the last tick
+  uint64_t last_us;
+  // index of the most recent tick since start / song position
+  int32_t tick;
+  // last measured phase error (raw - predicted) in microseconds
+  float error_us;
+  // smoothed absolute phase error in microseconds
+  float jitter_us;
+  uint16_t lock_count;
+  bool locked;
+  bool running;
+  // true once start/stop/continue has been received
+  bool transport;
+} MidiClock;
+
+void MidiClock_init(MidiClock *self) {
+  self->period_us = 0;
+  self->next_us = 0;
+  self->last_us = 0;
+  self->tick = -1;
+  self->error_us = 0;
+  self->jitter_us = 0;
+  self->lock_count = 0;
+  self->locked = false;
+  self->running = false;
+  self->transport = false;
+}
+
+float MidiClock_period_from_bpm(float bpm) {
+  return 60000000.0f / (bpm * MIDICLOCK_PPQN);
+}
+
+float MidiClock_bpm(MidiClock *self) {
+  if (self->period_us <= 0) {
+    return 0;
+  }
+  return 60000000.0f / (self->period_us * MIDICLOCK_PPQN);
+}
+
+void MidiClock_unlock(MidiClock *self) {
+  self->lock_count = 0;
+  self->locked = false;
+}
+
+// MidiClock_tick processes one 0xF8 received at now_us. Returns true when
+// the loop is locked.
+bool MidiClock_tick(MidiClock *self, uint64_t now_us) {
+  uint64_t last_us = self->last_us;
+  self->last_us = now_us;
+  if (self->running || !self->transport) {
+    // clock without any transport messages is treated as running
+    self->running = true;
+    self->tick++;
+  }
+
+  if (last_us == 0) {
+    // first tick ever, nothing to measure yet
+    return false;
+  }
+  if (self->period_us <= 0) {
+    // second tick seeds the period
+    float delta = (float)(now_us - last_us);
+    if (delta < MidiClock_period_from_bpm(MIDICLOCK_BPM_MAX) ||
+        delta > MidiClock_period_from_bpm(MIDICLOCK_BPM_MIN)) {
+      return false;
+    }
+    self->period_us = delta;
+    self->next_us = now_us + (uint64_t)delta;
+    return false;
+  }
+
+  float err = (float)((int64_t)(now_us - self->next_us));
+  if (err > self->period_us * MIDICLOCK_RESYNC_PERIODS ||
+      err < -self->period_us * MIDICLOCK_RESYNC_PERIODS) {
+    // clock went away or jumped, start measuring again
+    self->period_us = 0;
+    self->error_us = 0;
+    MidiClock_unlock(self);
+    return false;
+  }
+
+  self->error_us = err;
+  self->jitter_us += ((err < 0 ? -err : err) - self->jitter_us) * 0.05f;
+
+  // phase correction on the prediction, frequency correction on the period
+  float period = self->period_us + MIDICLOCK_KI * err;
+  if (period < MidiClock_period_from_bpm(MIDICLOCK_BPM_MAX)) {
+    period = MidiClock_period_from_bpm(MIDICLOCK_BPM_MAX);
+  } else if (period > MidiClock_period_from_bpm(MIDICLOCK_BPM_MIN)) {
+    period = MidiClock_period_from_bpm(MIDICLOCK_BPM_MIN);
+  }
+  self->next_us =
+      self->next_us + (int64_t)(self->period_us + MIDICLOCK_KP * err);
+  self->period_us = period;
+
+  if ((err < 0 ? -err : err) < self->period_us * MIDICLOCK_LOCK_ERROR) {
+    if (self->lock_count < MIDICLOCK_LOCK_TICKS) {
+      self->lock_count++;
+    }
+  } else {
+    self->lock_count = 0;
+  }
+  self->locked = self->lock_count >= MIDICLOCK_LOCK_TICKS;
+  return self->locked;
+}
+
+// MidiClock_start rewinds to the top; the next tick is tick 0.
+void MidiClock_start(MidiClock *self) {
+  self->transport = true;
+  self->running = true;
+  self->tick = -1;
+}
+
+// MidiClock_continue resumes from the current (or song) position.
+void MidiClock_continue(MidiClock *self) {
+  self->transport = true;
+  self->running = true;
+}
+
+void MidiClock_stop(MidiClock *self) {
+  self->transport = true;
+  self->running = false;
+}
+
+// MidiClock_release forgets the transport when the internal clock stops
+// leading. The stop it sends downstream is not a stop from a host, so the
+// follower starts over and clocks free-run at the global tempo until a
+// host clock or transport arrives.
+void MidiClock_release(MidiClock *self) { MidiClock_init(self); }
+
+// MidiClock_song_position moves to a position given in MIDI beats (16th
+// notes, 6 ticks each). Takes effect on the next tick.
+void MidiClock_song_position(MidiClock *self, uint16_t position) {
+  self->tick = (int32_t)position * 6 - 1;
+}
+
+// MidiClock_fraction returns how far [0,1) now_us is past the most recent
+// tick, measured along the filtered tick times.
+float MidiClock_fraction(MidiClock *self, uint64_t now_us) {
+  if (self->period_us <= 0) {
+    return 0;
+  }
+  int64_t since = (int64_t)(now_us - self->next_us) + (int64_t)self->period_us;
+  float frac = (float)since / self->period_us;
+  if (frac < 0) {
+    return 0;
+  } else if (frac > 0.999f) {
+    return 0.999f;
+  }
+  return frac;
+}
+
+// MidiClock_beats returns the position in quarter notes at now_us.
+float MidiClock_beats(MidiClock *self, uint64_t now_us) {
+  if (self->tick < 0) {
+    return 0;
+  }
+  return ((float)self->tick + MidiClock_fraction(self, now_us)) /
+         MIDICLOCK_PPQN;
+}
+
+// MidiClock_phase returns the phase [0,1) of a cycle that repeats division
+// times per quarter note. Computed in double so long sets keep their phase.
+float MidiClock_phase(MidiClock *self, uint64_t now_us, float division) {
+  if (self->tick < 0) {
+    return 0;
+  }
+  double cycles = ((double)self->tick + MidiClock_fraction(self, now_us)) *
+                  division / MIDICLOCK_PPQN;
+  return (float)(cycles - floor(cycles));
+}
+
+// MidiClock_present is true while ticks keep arriving.
+bool MidiClock_present(MidiClock *self, uint64_t now_us) {
+  if (self->last_us == 0 || self->period_us <= 0) {
+    return false;
+  }
+  return (now_us - self->last_us) <
+         (uint64_t)(self->period_us * MIDICLOCK_RESYNC_PERIODS);
+}
+
+// MidiClock_holding is true when the host stopped the transport, in which
+// case clocks following the global tempo hold low.
+bool MidiClock_holding(MidiClock *self) {
+  return self->transport && !self->running;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef LIB_MIDICLOCKOUT_H
+#define LIB_MIDICLOCKOUT_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+// MidiClockOut generates a 24 PPQN master clock from a hardware alarm. The
+// alarm reschedules itself relative to when it was due (not when it ran), and
+// the fractional part of the period is carried in 1/256 us so there is no
+// drift. TinyUSB is not interrupt safe, so the alarm only counts ticks and
+// timestamps them; MidiClockOut_take hands them to the main loop to send.
+
+#define MIDICLOCKOUT_PPQN 24
+#define MIDICLOCKOUT_BPM_MIN 20.0f
+#define MIDICLOCKOUT_BPM_MAX 400.0f
+#define MIDICLOCKOUT_START 0xFA
+#define MIDICLOCKOUT_STOP 0xFC
+
+typedef struct MidiClockOut {
+  float bpm;
+  // tick period in 1/256 microseconds
+  volatile uint32_t period_q8;
+  volatile uint32_t acc_q8;
+  // ticks generated by the alarm and not yet sent
+  volatile uint32_t pending;
+  // due time of the last generated tick
+  volatile uint64_t last_us;
+  volatile uint64_t due_us;
+  // transport message waiting to be sent (0 if none)
+  uint8_t transport;
+  alarm_id_t alarm;
+  bool enabled;
+  bool running;
+} MidiClockOut;
+
+int64_t MidiClockOut_alarm(alarm_id_t id, void *user_data) {
+  MidiClockOut *self = (MidiClockOut *)user_data;
+  self->last_us = self->due_us;
+  self->pending++;
+  uint32_t step = self->acc_q8 + self->period_q8;
+  self->acc_q8 = step & 0xff;
+  self->due_us += step >> 8;
+  // negative means relative to when this alarm was due
+  return -(int64_t)(step >> 8);
+}
+
+void MidiClockOut_set_bpm(MidiClockOut *self, float bpm) {
+  if (bpm < MIDICLOCKOUT_BPM_MIN) {
+    bpm = MIDICLOCKOUT_BPM_MIN;
+  } else if (bpm > MIDICLOCKOUT_BPM_MAX) {
+    bpm = MIDICLOCKOUT_BPM_MAX;
+  }
+  self->bpm = bpm;
+  self->period_q8 =
+      (uint32_t)(60000000.0f * 256.0f / (bpm * MIDICLOCKOUT_PPQN));
+}
+
+void MidiClockOut_init(MidiClockOut *self, float bpm) {
+  self->acc_q8 = 0;
+  self->pending = 0;
+  self->last_us = 0;
+  self->due_us = 0;
+  self->transport = 0;
+  self->alarm = 0;
+  self->enabled = false;
+  self->running = false;
+  MidiClockOut_set_bpm(self, bpm);
+}
+
+// MidiClockOut_restart puts the next tick one period from now.
+void MidiClockOut_restart(MidiClockOut *self) {
+  if (self->alarm > 0) {
+    cancel_alarm(self->alarm);
+    self->alarm = 0;
+  }
+  uint32_t status = save_and_disable_interrupts();
+  self->acc_q8 = self->period_q8 & 0xff;
+  self->pending = 0;
+  self->due_us = time_us_64() + (self->period_q8 >> 8);
+  restore_interrupts(status);
+  self->alarm = add_alarm_in_us(self->period_q8 >> 8, MidiClockOut_alarm,
+                                self, true);
+}
+
+void MidiClockOut_enable(MidiClockOut *self, bool enabled) {
+  if (enabled == self->enabled) {
+    return;
+  }
+  self->enabled = enabled;
+  if (enabled) {
+    MidiClockOut_restart(self);
+  } else {
+    if (self->alarm > 0) {
+      cancel_alarm(self->alarm);
+      self->alarm = 0;
+    }
+    if (self->running) {
+      self->running = false;
+      self->transport = MIDICLOCKOUT_STOP;
+    }
+  }
+}
+
+// MidiClockOut_start queues 0xFA and restarts the tick grid so the first
+// clock after start lands exactly one period later.
+void MidiClockOut_start(MidiClockOut *self) {
+  if (!self->enabled) {
+    return;
+  }
+  self->running = true;
+  self->transport = MIDICLOCKOUT_START;
+  MidiClockOut_restart(self);
+}
+
+void MidiClockOut_stop(MidiClockOut *self) {
+  if (!self->enabled) {
+    return;
+  }
+  self->running = false;
+  self->transport = MIDICLOCKOUT_STOP;
+}
+
+// MidiClockOut_take_transport returns the queued transport byte, if any.
+uint8_t MidiClockOut_take_transport(MidiClockOut *self) {
+  uint8_t transport = self->transport;
+  self->transport = 0;
+  return transport;
+}
+
+// MidiClockOut_take returns the number of ticks to send and the due time of
+// the most recent one.
+uint32_t MidiClockOut_take(MidiClockOut *self, uint64_t *tick_us) {
+  uint32_t status = save_and_disable_interrupts();
+  uint32_t pending = self->pending;
+  self->pending = 0;
+  *tick_us = self->last_us;
+  restore_interrupts(status);
+  return pending;
+}
+
+#endif
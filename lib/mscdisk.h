@@ -0,0 +1,167 @@
+#ifndef LIB_MSCDISK_H
+#define LIB_MSCDISK_H 1
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// MscDisk exposes the SD card as a USB mass storage device so scripts and
+// savefiles can be copied with a file manager. The MSC interface is always
+// in the configuration descriptor, but it reports "medium not present" until
+// storage mode is entered, so switching needs no re-enumeration. FatFs must
+// be unmounted while the host owns the card, the main loop does that around
+// MscDisk_enter and MscDisk_exit. Sectors go straight through the FatFs disk
+// layer (diskio.h) on drive 0.
+
+#define MSCDISK_BLOCK_SIZE 512
+
+#define MSCDISK_REQUEST_NONE 0
+#define MSCDISK_REQUEST_ENTER 1
+#define MSCDISK_REQUEST_EXIT 2
+
+typedef struct MscDisk {
+  volatile bool active;
+  // set from SysEx, a button combo or a host eject, handled by the main loop
+  volatile uint8_t request;
+  uint32_t sectors;
+  uint32_t reads;
+  uint32_t writes;
+  uint32_t errors;
+} MscDisk;
+
+MscDisk mscdisk;
+
+void MscDisk_init(MscDisk *self) {
+  self->active = false;
+  self->request = MSCDISK_REQUEST_NONE;
+  self->sectors = 0;
+  self->reads = 0;
+  self->writes = 0;
+  self->errors = 0;
+}
+
+void MscDisk_request(MscDisk *self, bool enter) {
+  if (enter != self->active) {
+    self->request = enter ? MSCDISK_REQUEST_ENTER : MSCDISK_REQUEST_EXIT;
+  }
+}
+
+// MscDisk_take returns the pending request and clears it.
+uint8_t MscDisk_take(MscDisk *self) {
+  uint8_t request = self->request;
+  self->request = MSCDISK_REQUEST_NONE;
+  return request;
+}
+
+// MscDisk_enter hands the card to the host. FatFs must already be unmounted.
+bool MscDisk_enter(MscDisk *self) {
+  if (disk_initialize(0) & STA_NOINIT) {
+    printf("[mscdisk] card not ready\n");
+    return false;
+  }
+  LBA_t count = 0;
+  if (disk_ioctl(0, GET_SECTOR_COUNT, &count) != RES_OK || count == 0) {
+    printf("[mscdisk] no sector count\n");
+    return false;
+  }
+  self->sectors = (uint32_t)count;
+  self->active = true;
+  printf("[mscdisk] exposing %" PRIu32 " sectors\n", self->sectors);
+  return true;
+}
+
+// MscDisk_exit takes the card back, flushing anything the card buffered.
+void MscDisk_exit(MscDisk *self) {
+  if (!self->active) {
+    return;
+  }
+  self->active = false;
+  disk_ioctl(0, CTRL_SYNC, NULL);
+  printf("[mscdisk] released, %" PRIu32 " reads %" PRIu32 " writes\n",
+         self->reads, self->writes);
+}
+
+#if CFG_TUD_MSC
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
+                        uint8_t product_id[16], uint8_t product_rev[4]) {
+  (void)lun;
+  const char vid[] = "Yocto";
+  const char pid[] = "SD Card";
+  const char rev[] = "1.0";
+  memcpy(vendor_id, vid, strlen(vid));
+  memcpy(product_id, pid, strlen(pid));
+  memcpy(product_rev, rev, strlen(rev));
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+  if (!mscdisk.active) {
+    // medium not present
+    tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+    return false;
+  }
+  return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count,
+                         uint16_t *block_size) {
+  (void)lun;
+  *block_count = mscdisk.active ? mscdisk.sectors : 0;
+  *block_size = MSCDISK_BLOCK_SIZE;
+}
+
+// an eject from the host ends storage mode
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start,
+                           bool load_eject) {
+  (void)lun;
+  (void)power_condition;
+  if (load_eject && !start && mscdisk.active) {
+    mscdisk.request = MSCDISK_REQUEST_EXIT;
+  }
+  return true;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+                          void *buffer, uint32_t bufsize) {
+  (void)lun;
+  if (!mscdisk.active) {
+    return -1;
+  }
+  // the endpoint buffer is one block, so offset is always block aligned
+  if (disk_read(0, buffer, lba + offset / MSCDISK_BLOCK_SIZE,
+                bufsize / MSCDISK_BLOCK_SIZE) != RES_OK) {
+    mscdisk.errors++;
+    return -1;
+  }
+  mscdisk.reads++;
+  return (int32_t)bufsize;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+                           uint8_t *buffer, uint32_t bufsize) {
+  (void)lun;
+  if (!mscdisk.active) {
+    return -1;
+  }
+  if (disk_write(0, buffer, lba + offset / MSCDISK_BLOCK_SIZE,
+                 bufsize / MSCDISK_BLOCK_SIZE) != RES_OK) {
+    mscdisk.errors++;
+    return -1;
+  }
+  mscdisk.writes++;
+  return (int32_t)bufsize;
+}
+
+// any other scsi command is not supported
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer,
+                        uint16_t bufsize) {
+  (void)scsi_cmd;
+  (void)buffer;
+  (void)bufsize;
+  tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+  return -1;
+}
+#endif
+
+#endif
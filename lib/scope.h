@@ -0,0 +1,229 @@
+#ifndef LIB_SCOPE_H
+#define LIB_SCOPE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Scope records the output voltages every control tick into a ring so they
+// can be streamed to the host at the real update rate. Samples are millivolts
+// and a batch is delta encoded per channel: a delta that fits in a signed
+// byte is one byte, anything else is SCOPE_ESCAPE followed by the absolute
+// value as int16 little endian. The first sample of every batch is absolute
+// so a lost batch does not corrupt the next one.
+//
+// In SCOPE_FREE every (decimated) sample is recorded. In the trigger modes
+// the scope waits for the trigger channel to cross level in the given
+// direction, records length samples and then waits for the next crossing.
+
+#define SCOPE_OFF 0
+#define SCOPE_FREE 1
+#define SCOPE_RISING 2
+#define SCOPE_FALLING 3
+
+#define SCOPE_RING 256
+#define SCOPE_ESCAPE -128
+// samples per batch, a batch of 8 escaped channels still fits a scene frame
+#define SCOPE_BATCH 24
+#define SCOPE_HEADER 6
+#define SCOPE_BATCH_MAX_SIZE (SCOPE_HEADER + 8 * SCOPE_BATCH * 3)
+#define SCOPE_NO_TRIGGER 0xFF
+// flags in the batch header
+#define SCOPE_FLAG_OVERFLOW 0x01
+
+typedef struct Scope {
+  uint8_t mode;
+  // bit mask of the channels to send
+  uint8_t channels;
+  // record every decimation-th tick
+  uint8_t decimation;
+  uint8_t trigger_channel;
+  int16_t trigger_level;
+  // samples recorded after a trigger
+  uint16_t length;
+  // transport the scope was configured from
+  uint8_t transport;
+
+  int16_t ring[SCOPE_RING][8];
+  uint16_t head;
+  uint16_t tail;
+  uint8_t tick;
+  uint16_t remaining;
+  bool armed;
+  // ring index of the sample that fired the trigger, -1 for none
+  int16_t trigger_index;
+  bool overflow;
+  uint16_t seq;
+  uint32_t dropped;
+} Scope;
+
+void Scope_init(Scope *self) {
+  self->mode = SCOPE_OFF;
+  self->channels = 0xFF;
+  self->decimation = 1;
+  self->trigger_channel = 0;
+  self->trigger_level = 0;
+  self->length = SCOPE_RING;
+  self->transport = 0;
+  self->head = 0;
+  self->tail = 0;
+  self->tick = 0;
+  self->remaining = 0;
+  self->armed = false;
+  self->trigger_index = -1;
+  self->overflow = false;
+  self->seq = 0;
+  self->dropped = 0;
+}
+
+void Scope_configure(Scope *self, uint8_t mode, uint8_t channels,
+                     uint8_t decimation, uint8_t trigger_channel,
+                     int16_t trigger_level, uint16_t length) {
+  Scope_init(self);
+  self->mode = mode;
+  self->channels = channels;
+  self->decimation = decimation > 0 ? decimation : 1;
+  self->trigger_channel = trigger_channel & 0x07;
+  self->trigger_level = trigger_level;
+  self->length = length > 0 ? length : SCOPE_RING;
+}
+
+uint16_t Scope_available(Scope *self) {
+  return (self->head - self->tail) & (SCOPE_RING - 1);
+}
+
+// Scope_sample is called every control tick with the output voltages.
+void Scope_sample(Scope *self, const float *volts) {
+  if (self->mode == SCOPE_OFF) {
+    return;
+  }
+  if (++self->tick < self->decimation) {
+    return;
+  }
+  self->tick = 0;
+  int16_t mv[8];
+  for (uint8_t i = 0; i < 8; i++) {
+    float v = volts[i] * 1000.0f;
+    mv[i] = (int16_t)(v < 0 ? v - 0.5f : v + 0.5f);
+  }
+  bool fired = false;
+  if (self->mode != SCOPE_FREE) {
+    int16_t v = mv[self->trigger_channel];
+    bool above = v >= self->trigger_level;
+    bool crossed = self->mode == SCOPE_RISING ? above : !above;
+    if (self->remaining == 0) {
+      // armed once the signal is on the other side of the level
+      if (!crossed) {
+        self->armed = true;
+      } else if (self->armed) {
+        self->armed = false;
+        self->remaining = self->length;
+        fired = true;
+      }
+    }
+    if (self->remaining == 0) {
+      return;
+    }
+    self->remaining--;
+  }
+  uint16_t next = (self->head + 1) & (SCOPE_RING - 1);
+  if (next == self->tail) {
+    self->overflow = true;
+    self->dropped++;
+    return;
+  }
+  for (uint8_t i = 0; i < 8; i++) {
+    self->ring[self->head][i] = mv[i];
+  }
+  if (fired && self->trigger_index < 0) {
+    // only the oldest trigger not yet sent is marked
+    self->trigger_index = self->head;
+  }
+  self->head = next;
+}
+
+// Scope_encode moves up to SCOPE_BATCH samples into a batch
+//   <seq u16> <count> <channels> <trigger> <flags> <deltas>
+// and returns its length, 0 when there is nothing to send. trigger is the
+// index of the sample that fired the trigger, or SCOPE_NO_TRIGGER.
+uint16_t Scope_encode(Scope *self, uint8_t *raw) {
+  uint16_t count = Scope_available(self);
+  if (count == 0) {
+    return 0;
+  }
+  if (count > SCOPE_BATCH) {
+    count = SCOPE_BATCH;
+  }
+  uint8_t trigger = SCOPE_NO_TRIGGER;
+  if (self->trigger_index >= 0) {
+    uint16_t offset = (self->trigger_index - self->tail) & (SCOPE_RING - 1);
+    if (offset < count) {
+      trigger = offset;
+      self->trigger_index = -1;
+    }
+  }
+  raw[0] = self->seq & 0xFF;
+  raw[1] = self->seq >> 8;
+  raw[2] = count;
+  raw[3] = self->channels;
+  raw[4] = trigger;
+  raw[5] = self->overflow ? SCOPE_FLAG_OVERFLOW : 0;
+  self->overflow = false;
+  uint16_t len = SCOPE_HEADER;
+  for (uint8_t ch = 0; ch < 8; ch++) {
+    if (!(self->channels & (1 << ch))) {
+      continue;
+    }
+    int16_t previous = 0;
+    for (uint16_t n = 0; n < count; n++) {
+      int16_t v = self->ring[(self->tail + n) & (SCOPE_RING - 1)][ch];
+      int32_t delta = (int32_t)v - previous;
+      if (n > 0 && delta > SCOPE_ESCAPE && delta < 128) {
+        raw[len++] = (uint8_t)(int8_t)delta;
+      } else {
+        raw[len++] = (uint8_t)SCOPE_ESCAPE;
+        raw[len++] = (uint16_t)v & 0xFF;
+        raw[len++] = (uint16_t)v >> 8;
+      }
+      previous = v;
+    }
+  }
+  self->tail = (self->tail + count) & (SCOPE_RING - 1);
+  self->seq++;
+  return len;
+}
+
+// Scope_decode reads a batch back into samples[count][8] (channels not in
+// the batch are left alone) and returns count, or -1 for a short batch.
+int32_t Scope_decode(const uint8_t *raw, uint16_t len, int16_t samples[][8]) {
+  if (len < SCOPE_HEADER) {
+    return -1;
+  }
+  uint8_t count = raw[2];
+  uint8_t channels = raw[3];
+  uint16_t i = SCOPE_HEADER;
+  for (uint8_t ch = 0; ch < 8; ch++) {
+    if (!(channels & (1 << ch))) {
+      continue;
+    }
+    int16_t v = 0;
+    for (uint8_t n = 0; n < count; n++) {
+      if (i >= len) {
+        return -1;
+      }
+      int8_t delta = (int8_t)raw[i++];
+      if (delta == SCOPE_ESCAPE) {
+        if (i + 2 > len) {
+          return -1;
+        }
+        v = (int16_t)(raw[i] | (raw[i + 1] << 8));
+        i += 2;
+      } else {
+        v += delta;
+      }
+      samples[n][ch] = v;
+    }
+  }
+  return count;
+}
+
+#endif
@@ -30,12 +30,15 @@ void SimpleTimer_set_bpm(SimpleTimer *self, float bpm) {
   // compute new time diff
   self->time_diff = 30000.0f / (self->bpm * self->division);
 
-  // compute new next time
+  // compute new next time, stepping whole half-periods from the first time
+  // without walking through every period since boot
   self->next_time = self->first_time + self->offset + self->time_diff;
   self->on = true;
-  while (self->next_time < self->last_time) {
-    self->next_time += self->time_diff;
-    self->on = !self->on;
+  if (self->next_time < self->last_time) {
+    uint32_t steps =
+        (uint32_t)ceilf((self->last_time - self->next_time) / self->time_diff);
+    self->next_time += steps * self->time_diff;
+    self->on = (steps % 2) == 0;
   }
 }
 
@@ -84,6 +87,31 @@ void SimpleTimer_reset(SimpleTimer *self, float current_time) {
   }
 }
 
+// SimpleTimer_sync locks the timer to an external position, given as the
+// number of full on/off cycles elapsed (only the fraction matters). The state only
+// flips (and fires the callback) when the timer is in the wrong half.
+void SimpleTimer_sync(SimpleTimer *self, float bpm, float division,
+                      float cycles, float current_time) {
+  self->bpm = bpm;
+  self->division = division;
+  self->time_diff = 30000.0f / (self->bpm * self->division);
+  float phase = cycles - floorf(cycles);
+  bool on = phase < 0.5f;
+  float remaining = on ? (0.5f - phase) : (1.0f - phase);
+  self->last_time = current_time;
+  self->next_time = current_time + remaining * 2.0f * self->time_diff;
+  // keep first_time on the start of an "on" half so a later
+  // SimpleTimer_set_bpm lands on the same edge
+  self->first_time =
+      self->next_time - (on ? 1.0f : 2.0f) * self->time_diff - self->offset;
+  if (on != self->on) {
+    self->on = on;
+    if (self->active && self->pulse_callback != NULL) {
+      self->pulse_callback(self->on, self->user_data);
+    }
+  }
+}
+
 // Main processing function for generating timer pulses
 bool SimpleTimer_process(SimpleTimer *self, float current_time) {
   self->last_time = current_time;
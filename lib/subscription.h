@@ -0,0 +1,142 @@
+#ifndef LIB_SUBSCRIPTION_H
+#define LIB_SUBSCRIPTION_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sysexbin.h"
+
+// Subscription keeps track of what the editor asked to be told about and
+// what it was last told, so the device can push STATE frames holding only
+// the values that changed instead of being polled. Changes between two
+// frames are coalesced: a frame carries the latest value of everything that
+// moved since the previous one. Values that did not fit in a full frame are
+// still marked unsent and go out in the next one.
+
+#define SUBSCRIPTION_VOLTAGES 0x01
+#define SUBSCRIPTION_PARAMS 0x02
+#define SUBSCRIPTION_GLOBAL 0x04
+
+#define SUBSCRIPTION_PERIOD_DEFAULT_MS 50
+#define SUBSCRIPTION_PERIOD_MIN_MS 10
+#define SUBSCRIPTION_PERIOD_MAX_MS 1000
+// an empty frame goes out this often so the host knows the device is there
+#define SUBSCRIPTION_KEEPALIVE_MS 1000
+// voltage changes smaller than ~1 mV (Q16.16) are not worth a frame
+#define SUBSCRIPTION_VOLTAGE_DEADBAND 66
+#define SUBSCRIPTION_UNSENT INT32_MIN
+
+typedef struct Subscription {
+  // SUBSCRIPTION_* flags, 0 when nobody is subscribed
+  uint8_t flags;
+  // bit mask of the outputs to report
+  uint8_t outputs;
+  uint16_t period_ms;
+  uint32_t last_ms;
+  uint32_t sent_ms;
+  // transport the subscription came in on, frames go back the same way
+  uint8_t transport;
+  // last values sent, Q16.16
+  int32_t scene;
+  int32_t tempo;
+  int32_t voltage[8];
+  int32_t params[8][SYSEXBIN_SCENE_PARAMS];
+  // scene the params were sent for, -1 for none
+  int8_t params_scene;
+  // frame being built
+  uint8_t *raw;
+  uint16_t len;
+} Subscription;
+
+// Subscription_invalidate_params marks every param unsent, e.g. after a
+// scene change.
+void Subscription_invalidate_params(Subscription *self) {
+  for (uint8_t output = 0; output < 8; output++) {
+    for (uint8_t param = 0; param < SYSEXBIN_SCENE_PARAMS; param++) {
+      self->params[output][param] = SUBSCRIPTION_UNSENT;
+    }
+  }
+}
+
+void Subscription_init(Subscription *self) {
+  self->flags = 0;
+  self->outputs = 0;
+  self->period_ms = SUBSCRIPTION_PERIOD_DEFAULT_MS;
+  self->last_ms = 0;
+  self->sent_ms = 0;
+  self->transport = 0;
+  self->params_scene = -1;
+  self->raw = NULL;
+  self->len = 0;
+}
+
+// Subscription_set replaces the subscription, flags 0 unsubscribes. The
+// first frame after subscribing has everything and is due right away.
+void Subscription_set(Subscription *self, uint8_t flags, uint8_t outputs,
+                      uint16_t period_ms, uint8_t transport, uint32_t now) {
+  if (period_ms == 0) {
+    period_ms = SUBSCRIPTION_PERIOD_DEFAULT_MS;
+  } else if (period_ms < SUBSCRIPTION_PERIOD_MIN_MS) {
+    period_ms = SUBSCRIPTION_PERIOD_MIN_MS;
+  } else if (period_ms > SUBSCRIPTION_PERIOD_MAX_MS) {
+    period_ms = SUBSCRIPTION_PERIOD_MAX_MS;
+  }
+  self->flags = flags;
+  self->outputs = outputs;
+  self->period_ms = period_ms;
+  self->transport = transport;
+  self->last_ms = now - period_ms;
+  self->sent_ms = now;
+  self->scene = SUBSCRIPTION_UNSENT;
+  self->tempo = SUBSCRIPTION_UNSENT;
+  for (uint8_t output = 0; output < 8; output++) {
+    self->voltage[output] = SUBSCRIPTION_UNSENT;
+  }
+  Subscription_invalidate_params(self);
+  self->params_scene = -1;
+}
+
+bool Subscription_due(Subscription *self, uint32_t now) {
+  return self->flags != 0 && now - self->last_ms >= self->period_ms;
+}
+
+void Subscription_begin(Subscription *self, uint8_t *raw) {
+  self->raw = raw;
+  self->len = 0;
+}
+
+// Subscription_add puts an entry in the frame if val moved more than
+// deadband from what was last sent. Once the frame is full nothing is
+// added and the value stays pending.
+void Subscription_add(Subscription *self, int32_t *last, uint8_t scene,
+                      uint8_t output, uint8_t param, float val,
+                      int32_t deadband) {
+  int32_t fixed = SysExBin_to_fixed(val);
+  if (*last != SUBSCRIPTION_UNSENT) {
+    int64_t diff = (int64_t)fixed - *last;
+    if (diff <= deadband && diff >= -deadband) {
+      return;
+    }
+  }
+  if (self->len + SYSEXBIN_ENTRY_SIZE >
+      SYSEXBIN_MAX_ENTRIES * SYSEXBIN_ENTRY_SIZE) {
+    return;
+  }
+  self->len += SysExBin_put_entry(&self->raw[self->len], scene, output, param,
+                                  val);
+  *last = fixed;
+}
+
+// Subscription_end returns the length of the frame to send, or -1 when
+// there is nothing to send yet.
+int32_t Subscription_end(Subscription *self, uint32_t now) {
+  self->last_ms = now;
+  if (self->len == 0 && now - self->sent_ms < SUBSCRIPTION_KEEPALIVE_MS) {
+    return -1;
+  }
+  self->sent_ms = now;
+  return self->len;
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef LIB_SYSEXBIN_H
+#define LIB_SYSEXBIN_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// SysExBin is the binary parameter protocol that runs next to the text one.
+// A frame (inside F0 .. F7) is
+//
+//   0x7D <version> <command> <7-bit packed payload>
+//
+// 0x7D is the non-commercial manufacturer id and never starts a text
+// command. The payload is packed 7-in-8: every group of up to 7 bytes is
+// preceded by a byte holding their high bits (bit 0 = first byte).
+//
+// SET and VALUES payloads are a list of 6-byte entries
+//   <scene << 3 | output> <param> <value, int32 Q16.16 little endian>
+// GET payloads are a list of 2-byte entries <scene << 3 | output> <param>.
+// Params are the fixed PARAM_* ids from yoctocore.h.
+//
+// Bulk transfers move a whole scene in one frame. DUMP asks for <scene>
+// (or SYSEXBIN_ALL_SCENES for every scene and the calibration). A SCENE
+// payload is
+//   <scene> <params> <Q16.16 value for each output, param> <crc32>
+// and a CALIBRATION payload is the raw float slope and intercept of each
+// output followed by a crc32 (an output calibrated with a table is sent as
+// the line through its ends). Sending either one back restores it, the
+// device answers with ACK <command> <scene> <status>.
+//
+// Code uploads (see codeupload.h) are
+//   CODE_BEGIN <scene> <output> <length u32> <crc32 u32>
+//   CODE_DATA <seq u16> <up to SYSEXBIN_CODE_CHUNK bytes>
+//   CODE_END
+// and the device answers with CODE_ACK <next seq u16> <status>.
+//
+// Code downloads (see codedownload.h) are asked for with
+//   CODE_GET <scene> <output>   (or CODE_GET SYSEXBIN_ALL_SCENES)
+// and each script comes back as
+//   CODE_HEADER <scene> <output> <status> <length u32> <crc32 u32>
+//   CODE_PART <scene> <output> <seq u16> <up to SYSEXBIN_CODE_CHUNK bytes>
+// until length bytes have been sent.
+//
+// The editor can subscribe to state instead of polling (see subscription.h)
+//   SUBSCRIBE <flags> <output mask> <period ms u16>   (flags 0 unsubscribes)
+// and the device pushes STATE frames, a list of SET style entries holding
+// what changed since the last frame. Output voltages and the tempo travel as
+// the SYSEXBIN_STATE_VOLTAGE and SYSEXBIN_STATE_TEMPO params, the scene as
+// PARAM_SCENE.
+//
+// The voltage scope (see scope.h) is set up with
+//   SCOPE <mode> <channel mask> <decimation> <trigger channel>
+//         <trigger level mV int16> <length u16>
+// (mode SCOPE_OFF stops it) and streams SCOPE_DATA batches as encoded by
+// Scope_encode.
+//
+// Streamed CV (see cvstream.h) is started with
+//   CV_STREAM <output mask> <period us u32> <depth>   (mask 0 stops it)
+// and fed with
+//   CV_FRAMES <ts u32> <count> <count frames of 8 int16 mV>
+// where ts is the position of the first frame in periods. The device
+// answers every few batches, and when a frame is dropped, with
+//   CV_STATUS <fill> <playing> <underruns u32> <late u32> <overflows u32>
+//
+// Script print() output (see luaconsole.h) is pushed a line at a time as
+//   CONSOLE <output> <time ms u32> <lines dropped before u16> <text>
+//
+// Binary log records (see binlog.h) are streamed after
+//   LOG <enable>
+// as LOG_DATA <records dropped u32> <records>, decoded by dev/binlog.py.
+
+#define SYSEXBIN_ID 0x7D
+#define SYSEXBIN_VERSION 1
+#define SYSEXBIN_HEADER 3
+
+#define SYSEXBIN_SET 0x01
+#define SYSEXBIN_GET 0x02
+#define SYSEXBIN_VALUES 0x03
+#define SYSEXBIN_DUMP 0x04
+#define SYSEXBIN_SCENE 0x05
+#define SYSEXBIN_CALIBRATION 0x06
+#define SYSEXBIN_ACK 0x07
+#define SYSEXBIN_CODE_BEGIN 0x08
+#define SYSEXBIN_CODE_DATA 0x09
+#define SYSEXBIN_CODE_END 0x0A
+#define SYSEXBIN_CODE_ACK 0x0B
+#define SYSEXBIN_CODE_GET 0x0C
+#define SYSEXBIN_CODE_HEADER 0x0D
+#define SYSEXBIN_CODE_PART 0x0E
+#define SYSEXBIN_SUBSCRIBE 0x0F
+#define SYSEXBIN_STATE 0x10
+#define SYSEXBIN_SCOPE 0x11
+#define SYSEXBIN_SCOPE_DATA 0x12
+#define SYSEXBIN_CV_STREAM 0x13
+#define SYSEXBIN_CV_FRAMES 0x14
+#define SYSEXBIN_CV_STATUS 0x15
+#define SYSEXBIN_CONSOLE 0x16
+#define SYSEXBIN_LOG 0x17
+#define SYSEXBIN_LOG_DATA 0x18
+
+#define SYSEXBIN_ALL_SCENES 0x7F
+// params that only appear in STATE frames
+#define SYSEXBIN_STATE_VOLTAGE 0x70
+#define SYSEXBIN_STATE_TEMPO 0x71
+#define SYSEXBIN_ACK_OK 0
+#define SYSEXBIN_ACK_BAD_CRC 1
+#define SYSEXBIN_ACK_BAD_SIZE 2
+
+#define SYSEXBIN_ENTRY_SIZE 6
+#define SYSEXBIN_GET_ENTRY_SIZE 2
+// entries per frame, keeps a reply well inside the tx queue
+#define SYSEXBIN_MAX_ENTRIES 64
+
+// params per output in a SCENE frame, PARAM_MODE .. PARAM_NOTE_TUNING
+#define SYSEXBIN_SCENE_PARAMS 23
+#define SYSEXBIN_CRC_SIZE 4
+#define SYSEXBIN_SCENE_SIZE \
+  (2 + 8 * SYSEXBIN_SCENE_PARAMS * 4 + SYSEXBIN_CRC_SIZE)
+#define SYSEXBIN_CALIBRATION_SIZE (8 * 2 * 4 + SYSEXBIN_CRC_SIZE)
+// script bytes per CODE_DATA frame
+#define SYSEXBIN_CODE_CHUNK 512
+
+#define SYSEXBIN_FIXED_ONE 65536.0f
+
+// SYSEXBIN_PACKED_SIZE is the packed length of n raw bytes.
+#define SYSEXBIN_PACKED_SIZE(n) ((n) + ((n) + 6) / 7)
+
+uint16_t SysExBin_pack7(const uint8_t *in, uint16_t len, uint8_t *out) {
+  uint16_t o = 0;
+  for (uint16_t i = 0; i < len; i += 7) {
+    uint8_t msb = 0;
+    uint16_t head = o++;
+    for (uint8_t j = 0; j < 7 && i + j < len; j++) {
+      msb |= (in[i + j] >> 7) << j;
+      out[o++] = in[i + j] & 0x7F;
+    }
+    out[head] = msb;
+  }
+  return o;
+}
+
+// SysExBin_unpack7 returns the number of raw bytes, or -1 if a byte has the
+// high bit set.
+int32_t SysExBin_unpack7(const uint8_t *in, uint16_t len, uint8_t *out) {
+  int32_t o = 0;
+  for (uint16_t i = 0; i < len; i += 8) {
+    uint8_t msb = in[i];
+    if (msb & 0x80) {
+      return -1;
+    }
+    for (uint8_t j = 0; j < 7 && i + 1 + j < len; j++) {
+      uint8_t b = in[i + 1 + j];
+      if (b & 0x80) {
+        return -1;
+      }
+      out[o++] = b | (((msb >> j) & 1) << 7);
+    }
+  }
+  return o;
+}
+
+bool SysExBin_is_frame(const uint8_t *msg, uint16_t len) {
+  return len >= SYSEXBIN_HEADER && msg[0] == SYSEXBIN_ID;
+}
+
+// SysExBin_encode writes a full frame (without F0/F7) and returns its length.
+uint16_t SysExBin_encode(uint8_t command, const uint8_t *raw, uint16_t len,
+                         uint8_t *out) {
+  out[0] = SYSEXBIN_ID;
+  out[1] = SYSEXBIN_VERSION;
+  out[2] = command;
+  return SYSEXBIN_HEADER + SysExBin_pack7(raw, len, out + SYSEXBIN_HEADER);
+}
+
+// SysExBin_decode checks the header and unpacks the payload into raw.
+// Returns the raw length, or -1 for a bad frame or unknown version.
+int32_t SysExBin_decode(const uint8_t *msg, uint16_t len, uint8_t *command,
+                        uint8_t *raw) {
+  if (!SysExBin_is_frame(msg, len) || msg[1] != SYSEXBIN_VERSION) {
+    return -1;
+  }
+  *command = msg[2];
+  return SysExBin_unpack7(msg + SYSEXBIN_HEADER, len - SYSEXBIN_HEADER, raw);
+}
+
+int32_t SysExBin_to_fixed(float val) {
+  float f = val * SYSEXBIN_FIXED_ONE;
+  if (f >= 2147483520.0f) {
+    return INT32_MAX;
+  } else if (f <= -2147483648.0f) {
+    return INT32_MIN;
+  }
+  return (int32_t)(f < 0 ? f - 0.5f : f + 0.5f);
+}
+
+float SysExBin_from_fixed(int32_t val) {
+  return (float)val / SYSEXBIN_FIXED_ONE;
+}
+
+void SysExBin_put_u32(uint8_t *raw, uint32_t val) {
+  raw[0] = val & 0xFF;
+  raw[1] = (val >> 8) & 0xFF;
+  raw[2] = (val >> 16) & 0xFF;
+  raw[3] = (val >> 24) & 0xFF;
+}
+
+uint32_t SysExBin_get_u32(const uint8_t *raw) {
+  return (uint32_t)raw[0] | ((uint32_t)raw[1] << 8) |
+         ((uint32_t)raw[2] << 16) | ((uint32_t)raw[3] << 24);
+}
+
+void SysExBin_put_fixed(uint8_t *raw, float val) {
+  SysExBin_put_u32(raw, (uint32_t)SysExBin_to_fixed(val));
+}
+
+float SysExBin_get_fixed(const uint8_t *raw) {
+  return SysExBin_from_fixed((int32_t)SysExBin_get_u32(raw));
+}
+
+// floats that must survive exactly (calibration) travel as their bits
+void SysExBin_put_float(uint8_t *raw, float val) {
+  uint32_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  SysExBin_put_u32(raw, bits);
+}
+
+float SysExBin_get_float(const uint8_t *raw) {
+  uint32_t bits = SysExBin_get_u32(raw);
+  float val;
+  memcpy(&val, &bits, sizeof(val));
+  return val;
+}
+
+// SysExBin_put_entry writes a 6-byte entry and returns the bytes written.
+uint16_t SysExBin_put_entry(uint8_t *raw, uint8_t scene, uint8_t output,
+                            uint8_t param, float val) {
+  raw[0] = (scene << 3) | (output & 0x07);
+  raw[1] = param;
+  SysExBin_put_fixed(&raw[2], val);
+  return SYSEXBIN_ENTRY_SIZE;
+}
+
+void SysExBin_get_entry(const uint8_t *raw, uint8_t *scene, uint8_t *output,
+                        uint8_t *param, float *val) {
+  *scene = raw[0] >> 3;
+  *output = raw[0] & 0x07;
+  *param = raw[1];
+  *val = SysExBin_get_fixed(&raw[2]);
+}
+
+// SysExBin_crc32_update continues a standard (zlib) CRC-32, start from 0.
+uint32_t SysExBin_crc32_update(uint32_t crc, const uint8_t *data,
+                               uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t j = 0; j < 8; j++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t SysExBin_crc32(const uint8_t *data, uint32_t len) {
+  return SysExBin_crc32_update(0, data, len);
+}
+
+// SysExBin_seal appends the crc32 of raw[0..len) and returns the new length.
+uint16_t SysExBin_seal(uint8_t *raw, uint16_t len) {
+  SysExBin_put_u32(&raw[len], SysExBin_crc32(raw, len));
+  return len + SYSEXBIN_CRC_SIZE;
+}
+
+// SysExBin_check verifies the trailing crc32 written by SysExBin_seal.
+bool SysExBin_check(const uint8_t *raw, uint16_t len) {
+  if (len < SYSEXBIN_CRC_SIZE) {
+    return false;
+  }
+  len -= SYSEXBIN_CRC_SIZE;
+  return SysExBin_get_u32(&raw[len]) == SysExBin_crc32(raw, len);
+}
+
+#endif
@@ -32,12 +32,10 @@
 #endif
 
 typedef struct TapTempo {
+  // microseconds of the last tap
   uint32_t last;
   uint16_t taps[TAPTEMPO_SIZE];
   uint8_t index;
-#ifdef LINUX_SYSTEM
-  struct timeval last_time;
-#endif
 } TapTempo;
 
 void TapTempo_init(TapTempo *self) {
@@ -47,7 +45,9 @@ void TapTempo_init(TapTempo *self) {
     self->taps[i] = 0;
   }
 #ifdef LINUX_SYSTEM
-  gettimeofday(&self->last_time, NULL);
+  struct timeval current_time;
+  gettimeofday(&current_time, NULL);
+  self->last = current_time.tv_sec * 1000000L + current_time.tv_usec;
 #else
   self->last = time_us_32();
 #endif
@@ -60,23 +60,11 @@ void TapTempo_reset(TapTempo *self) {
   }
 }
 
-// TapTempo_tap returns the current tempo in bpm
+// TapTempo_tap_at returns the current tempo in bpm for a tap at now_us,
 // calculated from a weighted average of the last taps
-uint16_t TapTempo_tap(TapTempo *self) {
-  // change the time calculation based on whether its linux or arduino
-  uint16_t milliseconds;
-#ifdef LINUX_SYSTEM
-  struct timeval current_time;
-  gettimeofday(&current_time, NULL);
-  milliseconds = ((current_time.tv_sec - self->last_time.tv_sec) * 1000000L +
-                  (current_time.tv_usec - self->last_time.tv_usec)) /
-                 1000;
-  self->last_time = current_time;
-#else
-  uint32_t current_time = time_us_32();
-  milliseconds = (current_time - self->last) / 1000;
-  self->last = current_time;
-#endif
+uint16_t TapTempo_tap_at(TapTempo *self, uint32_t now_us) {
+  uint32_t milliseconds = (now_us - self->last) / 1000;
+  self->last = now_us;
   if (milliseconds > TAPTEMPO_MS_LIMIT) {
     for (int i = 0; i < TAPTEMPO_SIZE; i++) {
       self->taps[i] = 0;
@@ -102,4 +90,16 @@ uint16_t TapTempo_tap(TapTempo *self) {
   return round(bpm);
 }
 
+// TapTempo_tap taps at the current time
+uint16_t TapTempo_tap(TapTempo *self) {
+#ifdef LINUX_SYSTEM
+  struct timeval current_time;
+  gettimeofday(&current_time, NULL);
+  return TapTempo_tap_at(self, current_time.tv_sec * 1000000L +
+                                   current_time.tv_usec);
+#else
+  return TapTempo_tap_at(self, time_us_32());
+#endif
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BINLOG_LEVEL_KNOB BINLOG_WARN
+
+uint32_t fake_time = 0;
+uint32_t time_us_32() { return fake_time; }
+
+#include "../../binlog.h"
+
+uint32_t word(uint8_t *b) {
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+int main() {
+  BinLog_init(&binlog);
+  uint8_t out[256];
+  assert(BinLog_read(&binlog, out, sizeof(out)) == 0);
+
+  // a record is id|nargs, time, args
+  fake_time = 1234;
+  BINLOG(MIDI, BINLOG_INFO, NOTE_ON, 1, 60, 100);
+  BINLOG(MIDI, BINLOG_INFO, CC_OUT, 2, BINLOG_F(1.5f));
+  uint16_t len = BinLog_read(&binlog, out, sizeof(out));
+  assert(len == 5 * 4 + 4 * 4);
+  assert(word(out) == (BINLOG_ID_NOTE_ON | (3 << 16)));
+  assert(word(out + 4) == 1234);
+  assert(word(out + 8) == 1 && word(out + 12) == 60 && word(out + 16) == 100);
+  assert(word(out + 20) == (BINLOG_ID_CC_OUT | (2 << 16)));
+  uint32_t bits = word(out + 32);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  assert(f == 1.5f);
+
+  // messages above the subsystem level are not logged
+  BINLOG(KNOB, BINLOG_INFO, KNOB, 1, 2);
+  assert(BinLog_used(&binlog) == 0);
+  BINLOG(KNOB, BINLOG_WARN, KNOB, 1, 2);
+  assert(BinLog_used(&binlog) == 4);
+
+  // reads only return whole records
+  assert(BinLog_read(&binlog, out, 15) == 0);
+  assert(BinLog_read(&binlog, out, 16) == 16);
+
+  // a full ring drops new records and counts them
+  BinLog_init(&binlog);
+  for (uint32_t i = 0; i < BINLOG_WORDS; i++) {
+    BINLOG(SYSTEM, BINLOG_INFO, FREE_HEAP, i);
+  }
+  assert(binlog.dropped > 0);
+  assert(binlog.logged + binlog.dropped == BINLOG_WORDS);
+  // the oldest records survive and the ring drains in order
+  uint32_t expect = 0;
+  while ((len = BinLog_read(&binlog, out, sizeof(out))) > 0) {
+    for (uint16_t i = 0; i < len; i += 12) {
+      assert(word(out + i) == (BINLOG_ID_FREE_HEAP | (1 << 16)));
+      assert(word(out + i + 8) == expect++);
+    }
+  }
+  assert(expect == binlog.logged);
+
+  printf("binlog tests passed\n");
+  return 0;
+}
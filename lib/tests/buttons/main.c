@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LINUX_SYSTEM 1
+#include "../../buttons.h"
+
+int main() {
+  Buttons buttons;
+  ButtonEvent event;
+  Buttons_reset(&buttons, 9);
+  assert(!Buttons_next(&buttons, &event));
+
+  // a press with bounces is one event at the first edge
+  uint64_t t = 100000;
+  assert(Buttons_edge(&buttons, 3, true, t));
+  assert(!Buttons_edge(&buttons, 3, false, t + 200));
+  assert(!Buttons_edge(&buttons, 3, true, t + 400));
+  assert(!Buttons_edge(&buttons, 3, true, t + 600));
+  assert(Buttons_pressed(&buttons, 3));
+  assert(Buttons_next(&buttons, &event));
+  assert(event.button == 3 && event.pressed && event.time_us == t);
+  assert(!Buttons_next(&buttons, &event));
+
+  // the release is taken once the press has settled
+  assert(!Buttons_edge(&buttons, 3, false, t + BUTTONS_DEBOUNCE_US - 1));
+  assert(Buttons_edge(&buttons, 3, false, t + BUTTONS_DEBOUNCE_US));
+  assert(Buttons_next(&buttons, &event));
+  assert(event.button == 3 && !event.pressed);
+
+  // buttons debounce on their own and events keep their order
+  t += 1000000;
+  Buttons_edge(&buttons, 8, true, t);
+  Buttons_edge(&buttons, 0, true, t + 10);
+  Buttons_edge(&buttons, 8, false, t + 20);
+  Buttons_edge(&buttons, 0, false, t + 30000);
+  uint8_t order[3] = {8, 0, 0};
+  for (uint8_t i = 0; i < 3; i++) {
+    assert(Buttons_next(&buttons, &event));
+    assert(event.button == order[i]);
+  }
+  assert(!Buttons_next(&buttons, &event));
+  assert(Buttons_pressed(&buttons, 8));
+  assert(!Buttons_pressed(&buttons, 0));
+
+  // a full queue drops events but keeps the state
+  Buttons_reset(&buttons, 9);
+  t = 100000;
+  for (uint8_t i = 0; i < BUTTONS_QUEUE + 4; i++) {
+    Buttons_edge(&buttons, 1, i % 2 == 0, t);
+    t += BUTTONS_DEBOUNCE_US;
+  }
+  assert(buttons.dropped == 5);
+  assert(!Buttons_pressed(&buttons, 1));
+  uint8_t n = 0;
+  while (Buttons_next(&buttons, &event)) {
+    assert(event.pressed == (n % 2 == 0));
+    n++;
+  }
+  assert(n == BUTTONS_QUEUE - 1);
+
+  // a flush drops stale events without replaying presses, and releases what
+  // was let go in the meantime
+  Buttons_reset(&buttons, 9);
+  t = 100000;
+  uint8_t combo[3] = {8, 0, 7};
+  for (uint8_t i = 0; i < 3; i++) {
+    Buttons_edge(&buttons, combo[i], true, t);
+  }
+  while (Buttons_next(&buttons, &event)) {
+  }
+  // unread: the combo is let go and held again, 3 taps and 5 goes down
+  t += BUTTONS_DEBOUNCE_US;
+  for (uint8_t i = 0; i < 3; i++) {
+    Buttons_edge(&buttons, combo[i], false, t);
+  }
+  Buttons_edge(&buttons, 3, true, t);
+  Buttons_edge(&buttons, 5, true, t);
+  t += BUTTONS_DEBOUNCE_US;
+  for (uint8_t i = 0; i < 3; i++) {
+    Buttons_edge(&buttons, combo[i], true, t);
+  }
+  Buttons_edge(&buttons, 3, false, t);
+  Buttons_flush(&buttons, t + 1);
+  assert(!Buttons_next(&buttons, &event));
+  assert(Buttons_pressed(&buttons, 8) && Buttons_pressed(&buttons, 5));
+  // shift let go while unread comes out as a release at the flush
+  t += BUTTONS_DEBOUNCE_US;
+  Buttons_edge(&buttons, 8, false, t);
+  Buttons_flush(&buttons, t + 1);
+  assert(Buttons_next(&buttons, &event));
+  assert(event.button == 8 && !event.pressed && event.time_us == t + 1);
+  assert(!Buttons_next(&buttons, &event));
+
+  printf("buttons tests passed\n");
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../cvstream.h"
+
+void frame(int16_t *mv, uint32_t ts) {
+  for (uint8_t i = 0; i < 8; i++) {
+    mv[i] = (int16_t)(ts * 10 + i);
+  }
+}
+
+int main() {
+  CvStream cv;
+  CvStream_init(&cv);
+  float volts[8] = {0};
+  int16_t mv[8];
+
+  // stopped streams never touch the outputs
+  assert(!CvStream_play(&cv, 0, volts));
+
+  CvStream_start(&cv, 0x0F, 1000, 4);
+  // nothing plays until depth frames are buffered
+  for (uint32_t ts = 0; ts < 3; ts++) {
+    frame(mv, ts);
+    assert(CvStream_push(&cv, ts, mv));
+  }
+  assert(!CvStream_play(&cv, 0, volts));
+  frame(mv, 3);
+  CvStream_push(&cv, 3, mv);
+  assert(CvStream_play(&cv, 10000, volts));
+  assert(volts[0] == 0.0f && volts[3] == 0.003f);
+  // only streamed channels are written
+  assert(volts[4] == 0.0f);
+
+  // frames arrive in bursts but play out one per period
+  uint32_t ts = 4;
+  uint64_t now = 10000;
+  for (uint32_t tick = 1; tick < 200; tick++) {
+    // a burst of 4 every 4 ms
+    if (tick % 4 == 0) {
+      for (uint8_t n = 0; n < 4; n++, ts++) {
+        frame(mv, ts);
+        CvStream_push(&cv, ts, mv);
+      }
+    }
+    now += 1000;
+    CvStream_play(&cv, now, volts);
+    assert(volts[1] == (tick * 10 + 1) / 1000.0f);
+  }
+  assert(cv.underruns == 0 && cv.late == 0 && cv.overflows == 0);
+
+  // duplicates and out of order frames are dropped
+  frame(mv, 5);
+  assert(!CvStream_push(&cv, 5, mv));
+  assert(cv.late == 1);
+
+  // running dry holds the last voltages and counts an underrun
+  float held;
+  for (uint8_t n = 0; n < 20; n++) {
+    now += 1000;
+    CvStream_play(&cv, now, volts);
+  }
+  assert(cv.underruns == 1 && !cv.playing);
+  held = volts[1];
+  now += 1000;
+  CvStream_play(&cv, now, volts);
+  assert(volts[1] == held);
+
+  // a host clock that runs fast does not overflow the buffer
+  CvStream_start(&cv, 0xFF, 1000, 4);
+  now = 0;
+  ts = 0;
+  for (uint32_t tick = 0; tick < 2000; tick++) {
+    // 11 frames every 10 ms, 10% fast
+    if (tick % 10 == 0) {
+      for (uint8_t n = 0; n < 11; n++, ts++) {
+        frame(mv, ts);
+        CvStream_push(&cv, ts, mv);
+      }
+    }
+    now += 1000;
+    CvStream_play(&cv, now, volts);
+    assert(CvStream_fill(&cv) < CVSTREAM_FRAMES - 11);
+  }
+  assert(cv.overflows == 0);
+
+  printf("cvstream tests passed\n");
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../daccode.h"
+
+#define REFERENCE 5.0f
+
+// reference is the float math DAC_set_voltage and MCP4728_update used to do
+uint16_t reference(float voltage, float slope, float intercept, bool raw) {
+  if (raw) {
+    // use voltage as it is
+  } else if (intercept != 0) {
+    voltage = (voltage - intercept) / slope;
+  }
+  voltage = (voltage + 5.0f) / 3.0f;
+  if (voltage < 0) {
+    voltage = 0;
+  } else if (voltage > REFERENCE) {
+    voltage = REFERENCE;
+  }
+  voltage = REFERENCE - voltage;
+  return (uint16_t)round(voltage * 4095.0 / REFERENCE);
+}
+
+// reference_points interpolates a table of measured voltages in float
+uint16_t reference_points(float voltage, const float *measured) {
+  int k = 0;
+  while (k + 1 < DACCODE_SEGMENTS && voltage >= measured[k + 1]) {
+    k++;
+  }
+  float setpoint = DACCODE_POINT_MIN + k +
+                   (voltage - measured[k]) / (measured[k + 1] - measured[k]);
+  return reference(setpoint, 0, 0, true);
+}
+
+int main() {
+  float calibrations[][2] = {
+      {0, 0},          {1.0f, 0.001f},    {0.98f, -0.05f},
+      {1.03f, 0.08f},  {0.995f, 0.0123f}, {1.0101f, -0.2f},
+  };
+  DacCode code;
+  uint32_t checked = 0;
+  uint32_t exact = 0;
+  for (uint8_t c = 0; c < 6; c++) {
+    for (uint8_t raw = 0; raw < 2; raw++) {
+      float slope = calibrations[c][0];
+      float intercept = calibrations[c][1];
+      DacCode_set(&code, slope, intercept, raw, REFERENCE);
+      for (float v = -6.0f; v <= 11.0f; v += 0.00037f) {
+        uint16_t want = reference(v, slope, intercept, raw);
+        uint16_t got = DacCode_from_voltage(&code, v);
+        if (abs((int)want - (int)got) > 1) {
+          printf("v=%f slope=%f intercept=%f raw=%d want %d got %d\n", v,
+                 slope, intercept, raw, want, got);
+          assert(false);
+        }
+        checked++;
+        if (want == got) {
+          exact++;
+        }
+      }
+    }
+  }
+  // off by one only where the float math rounds the other way
+  assert(exact > checked / 100 * 99);
+
+  // the ends of the range
+  DacCode_set(&code, 0, 0, false, REFERENCE);
+  assert(DacCode_from_voltage(&code, -5.0f) == 4095);
+  assert(DacCode_from_voltage(&code, 10.0f) == 0);
+  assert(DacCode_from_voltage(&code, 0.0f) == 2730);
+  assert(DacCode_from_voltage(&code, 1e9f) == 0);
+  assert(DacCode_from_voltage(&code, -1e9f) == 4095);
+
+  // dithered codes stay within one step and average to the exact code
+  DacCode_set(&code, 1.003f, 0.021f, false, REFERENCE);
+  for (float v = 0.0f; v < 1.0f; v += 0.0123f) {
+    int32_t error = 0;
+    int32_t exact = DacCode_exact(&code, v);
+    uint16_t rounded = DacCode_from_voltage(&code, v);
+    int64_t sum = 0;
+    for (uint16_t n = 0; n < 1000; n++) {
+      uint16_t got = DacCode_dither(&code, v, &error);
+      assert(abs((int)got - (int)rounded) <= 1);
+      sum += got;
+    }
+    double average = (double)sum / 1000.0;
+    assert(fabs(average - exact / 65536.0) < 0.01);
+  }
+  // the clamped ends do not build up error
+  int32_t error = 0;
+  for (uint16_t n = 0; n < 100; n++) {
+    assert(DacCode_dither(&code, 20.0f, &error) == 0);
+  }
+  assert(DacCode_dither(&code, 0.0f, &error) ==
+         DacCode_from_voltage(&code, 0.0f));
+
+  // a table measured off a straight line matches the slope and intercept
+  float measured[DACCODE_POINTS];
+  for (uint8_t k = 0; k < DACCODE_POINTS; k++) {
+    measured[k] = 1.003f * (DACCODE_POINT_MIN + k) + 0.021f;
+  }
+  assert(DacCode_points_valid(measured));
+  DacCode line;
+  DacCode_set(&line, 1.003f, 0.021f, false, REFERENCE);
+  DacCode_set_points(&code, measured, REFERENCE);
+  for (float v = -6.0f; v <= 11.0f; v += 0.0013f) {
+    assert(abs((int)DacCode_from_voltage(&code, v) -
+               (int)DacCode_from_voltage(&line, v)) <= 1);
+  }
+
+  // a bowed output hits the nominal code at every measured point and
+  // follows the float interpolation in between
+  for (uint8_t k = 0; k < DACCODE_POINTS; k++) {
+    float x = DACCODE_POINT_MIN + k;
+    measured[k] = 0.998f * x + 0.004f * x * x / 10.0f - 0.013f;
+  }
+  assert(DacCode_points_valid(measured));
+  DacCode_set_points(&code, measured, REFERENCE);
+  for (uint8_t k = 0; k < DACCODE_POINTS; k++) {
+    assert(DacCode_from_voltage(&code, measured[k]) ==
+           reference(DACCODE_POINT_MIN + k, 0, 0, true));
+  }
+  for (float v = -5.0f; v <= 10.0f; v += 0.00041f) {
+    uint16_t want = reference_points(v, measured);
+    uint16_t got = DacCode_from_voltage(&code, v);
+    if (abs((int)want - (int)got) > 1) {
+      printf("table v=%f want %d got %d\n", v, want, got);
+      assert(false);
+    }
+  }
+
+  // tables that are out of order or missing a point are refused
+  float swapped = measured[3];
+  measured[3] = measured[4];
+  measured[4] = swapped;
+  assert(!DacCode_points_valid(measured));
+  measured[4] = measured[3];
+  measured[3] = swapped;
+  measured[7] = 0;
+  assert(!DacCode_points_valid(measured));
+
+  printf("daccode tests passed (%u of %u exact)\n", exact, checked);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../knob_change.h"
+
+// noise is a few 14-bit steps of the ADC, in knob units
+float noise() { return ((float)rand() / RAND_MAX - 0.5f) * 0.2f; }
+
+int main() {
+  KnobChange knob;
+  srand(1);
+
+  // the power up position is not a change
+  KnobChange_init(&knob, 0.25f);
+  assert(KnobChange_update(&knob, 500.0f) == -1);
+  assert(KnobChange_get(&knob) == -1);
+
+  // a knob at rest does not report noise
+  uint16_t changes = 0;
+  for (uint16_t n = 0; n < 2000; n++) {
+    if (KnobChange_update(&knob, 500.0f + noise()) != -1) {
+      changes++;
+    }
+  }
+  assert(changes == 0);
+
+  // a slow turn is reported in steps finer than the old 10-bit ones and
+  // ends where the knob stopped
+  float last = 500.0f;
+  changes = 0;
+  for (uint16_t n = 0; n < 1000; n++) {
+    float changed = KnobChange_update(&knob, 500.0f + n * 0.01f + noise());
+    if (changed != -1) {
+      assert(fabsf(changed - last) < 1.0f);
+      assert(changed > last);
+      last = changed;
+      changes++;
+    }
+  }
+  assert(changes >= 20);
+  for (uint16_t n = 0; n < 200; n++) {
+    KnobChange_update(&knob, 510.0f + noise());
+  }
+  assert(fabsf(knob.value - 510.0f) < 0.3f);
+
+  // a fast turn follows without lag
+  for (uint16_t n = 1; n <= 10; n++) {
+    KnobChange_update(&knob, 510.0f + n * 40.0f);
+  }
+  assert(fabsf(knob.value - 910.0f) < 1.0f);
+  assert(KnobChange_get(&knob) != -1);
+  assert(KnobChange_get(&knob) == -1);
+
+  // the ends of the range are reached exactly
+  for (uint16_t n = 0; n < 200; n++) {
+    KnobChange_update(&knob, KNOB_CHANGE_MAX - fabsf(noise()));
+  }
+  assert(knob.last == KNOB_CHANGE_MAX);
+  for (uint16_t n = 0; n < 200; n++) {
+    KnobChange_update(&knob, fabsf(noise()));
+  }
+  assert(knob.last == 0);
+
+  printf("knobchange tests passed\n");
+  return 0;
+}
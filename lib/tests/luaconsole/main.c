@@ -0,0 +1,82 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../luaconsole.h"
+
+int main() {
+  LuaConsole console;
+  LuaConsole_init(&console);
+  assert(LuaConsole_peek(&console) == NULL);
+
+  // lines come out in order, tagged
+  assert(LuaConsole_push(&console, 3, 100, "hello", 5));
+  assert(LuaConsole_push(&console, 0, 101, "repl", 4));
+  LuaConsoleLine *line = LuaConsole_peek(&console);
+  assert(line->output == 3 && line->time_ms == 100 && line->len == 5);
+  assert(memcmp(line->text, "hello", 5) == 0);
+  LuaConsole_pop(&console);
+  line = LuaConsole_peek(&console);
+  assert(line->output == 0 && memcmp(line->text, "repl", 4) == 0);
+  LuaConsole_pop(&console);
+  assert(LuaConsole_available(&console) == 0);
+
+  // output 1 is the script at index 0 and is not mistaken for the REPL
+  assert(LuaConsole_script_output(0) == 1);
+  assert(LuaConsole_script_output(7) == 8);
+  assert(LuaConsole_script_output(0) != LUACONSOLE_REPL);
+  assert(LuaConsole_push(&console, LuaConsole_script_output(0), 102, "out1",
+                         4));
+  line = LuaConsole_peek(&console);
+  assert(line->output == 1 && memcmp(line->text, "out1", 4) == 0);
+  LuaConsole_pop(&console);
+
+  // long lines are cut
+  char text[200];
+  memset(text, 'x', sizeof(text));
+  assert(LuaConsole_push(&console, 1, 200, text, sizeof(text)));
+  assert(LuaConsole_peek(&console)->len == LUACONSOLE_LINE_SIZE);
+  LuaConsole_pop(&console);
+
+  // a chatty script gets its burst, then is held to the rate, without
+  // affecting the other outputs
+  LuaConsole_init(&console);
+  uint32_t ok = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    if (LuaConsole_push(&console, 5, 1000, "spam", 4)) {
+      ok++;
+    }
+  }
+  assert(ok == LUACONSOLE_BURST);
+  assert(console.dropped_rate == 100 - LUACONSOLE_BURST);
+  assert(LuaConsole_push(&console, 6, 1000, "quiet", 5));
+  // the line after a gap says how much was lost
+  for (uint8_t i = 0; i < LUACONSOLE_BURST; i++) {
+    LuaConsole_pop(&console);
+  }
+  line = LuaConsole_peek(&console);
+  assert(line->output == 6 && line->dropped == 100 - LUACONSOLE_BURST);
+  LuaConsole_pop(&console);
+  // one second later the rate allows LUACONSOLE_RATE more (capped by burst)
+  ok = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    if (LuaConsole_push(&console, 5, 2000, "spam", 4)) {
+      ok++;
+    }
+  }
+  assert(ok == (LUACONSOLE_RATE < LUACONSOLE_BURST ? LUACONSOLE_RATE
+                                                    : LUACONSOLE_BURST));
+
+  // a full ring drops and counts
+  LuaConsole_init(&console);
+  for (uint32_t i = 0; i < 100; i++) {
+    LuaConsole_push(&console, i % 9, 10000 + i * 100, "line", 4);
+  }
+  assert(LuaConsole_available(&console) == LUACONSOLE_LINES - 1);
+  assert(console.dropped_full > 0);
+
+  printf("luaconsole tests passed\n");
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../midiclock.h"
+
+// jitter in microseconds, uniform in [-amount, amount]
+int64_t jitter(int64_t amount) {
+  return (rand() % (2 * amount + 1)) - amount;
+}
+
+// run the clock for a number of beats at a tempo, returns the worst phase
+// error (filtered beat position vs the true grid) after lock, in beats
+float run(MidiClock *clock, uint64_t *t, float bpm, int beats,
+          int64_t jitter_us) {
+  float worst = 0;
+  double period = 60000000.0 / (bpm * MIDICLOCK_PPQN);
+  double grid = (double)*t;
+  for (int i = 0; i < beats * MIDICLOCK_PPQN; i++) {
+    grid += period;
+    *t = (uint64_t)grid;
+    MidiClock_tick(clock, *t + jitter(jitter_us));
+    if (clock->locked) {
+      // position halfway to the next tick measured against the true grid
+      float frac = MidiClock_fraction(clock, *t + (uint64_t)(period / 2));
+      float err = fabsf(frac - 0.5f) / MIDICLOCK_PPQN;
+      if (err > worst) {
+        worst = err;
+      }
+    }
+  }
+  return worst;
+}
+
+int main() {
+  srand(1);
+  MidiClock clock;
+  MidiClock_init(&clock);
+  uint64_t t = 1000000;
+
+  // steady 120 bpm with 1 ms of usb jitter
+  float worst = run(&clock, &t, 120.0f, 64, 1000);
+  printf("120 bpm: %2.3f bpm, locked=%d, worst=%f beats, jitter=%2.0f us\n",
+         MidiClock_bpm(&clock), clock.locked, worst, clock.jitter_us);
+  assert(clock.locked);
+  assert(fabsf(MidiClock_bpm(&clock) - 120.0f) < 0.2f);
+  // within 1.5 ms at 120 bpm
+  assert(worst < 0.003f);
+
+  // tempo change re-locks
+  worst = run(&clock, &t, 93.5f, 64, 1000);
+  printf("93.5 bpm: %2.3f bpm, locked=%d\n", MidiClock_bpm(&clock),
+         clock.locked);
+  assert(clock.locked);
+  assert(fabsf(MidiClock_bpm(&clock) - 93.5f) < 0.2f);
+
+  // long set without drift: 2 hours at 128 bpm
+  run(&clock, &t, 128.0f, 32, 1000);
+  worst = run(&clock, &t, 128.0f, 128 * 120, 1000);
+  printf("2h at 128 bpm: worst=%f beats\n", worst);
+  assert(worst < 0.003f);
+
+  // phase of a x4 cycle one tick after the top of a beat
+  MidiClock_start(&clock);
+  run(&clock, &t, 128.0f, 1, 0);
+  float phase = MidiClock_phase(&clock, t, 4.0f);
+  printf("x4 phase at tick %d: %f\n", (int)clock.tick, phase);
+  assert(fabsf(phase - (23 * 4 % 24) / 24.0f) < 0.02f);
+
+  // transport: start rewinds, stop holds, song position + continue
+  MidiClock_start(&clock);
+  run(&clock, &t, 128.0f, 4, 0);
+  assert(clock.tick == 4 * MIDICLOCK_PPQN - 1);
+  MidiClock_stop(&clock);
+  assert(MidiClock_holding(&clock));
+  run(&clock, &t, 128.0f, 1, 0);
+  assert(clock.tick == 4 * MIDICLOCK_PPQN - 1);
+  MidiClock_song_position(&clock, 16);
+  MidiClock_continue(&clock);
+  run(&clock, &t, 128.0f, 1, 0);
+  // 16 sixteenths = 4 beats, plus one beat of ticks
+  printf("position after continue: %2.2f beats\n",
+         MidiClock_beats(&clock, t));
+  assert(clock.tick == 16 * 6 + MIDICLOCK_PPQN - 1);
+
+  // master to follower: the internal clock stops and hands over, the
+  // outputs free-run instead of holding for a host that may never come
+  MidiClock_start(&clock);
+  run(&clock, &t, 128.0f, 1, 0);
+  MidiClock_stop(&clock);
+  assert(MidiClock_holding(&clock));
+  MidiClock_release(&clock);
+  assert(!MidiClock_holding(&clock));
+  assert(!clock.running && !clock.transport);
+  // a host clock without transport is followed straight away
+  run(&clock, &t, 100.0f, 4, 0);
+  assert(clock.running && !MidiClock_holding(&clock));
+  assert(fabsf(MidiClock_bpm(&clock) - 100.0f) < 0.5f);
+  printf("handoff to follower ok\n");
+
+  // clock disappears then comes back
+  t += 5000000;
+  run(&clock, &t, 140.0f, 16, 500);
+  printf("resync 140 bpm: %2.3f bpm, locked=%d\n", MidiClock_bpm(&clock),
+         clock.locked);
+  assert(clock.locked);
+  printf("ok\n");
+  return 0;
+}
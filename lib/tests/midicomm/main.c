@@ -0,0 +1,103 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// stand-ins for TinyUSB and the pico-sdk, the stream is read from a buffer
+#define MIDI_CIN_1BYTE_DATA 0x0F
+typedef uint32_t absolute_time_t;
+
+bool usb_midi_present = false;
+uint8_t stream[64];
+uint32_t stream_len = 0;
+uint32_t stream_pos = 0;
+
+bool tud_ready() { return true; }
+void tud_task() {}
+void sleep_ms(uint32_t ms) {}
+void reset_usb_boot(uint32_t a, uint32_t b) {}
+absolute_time_t get_absolute_time() { return 0; }
+uint32_t to_ms_since_boot(absolute_time_t t) { return t; }
+uint32_t tud_midi_n_available(uint8_t itf, uint8_t cable) {
+  return stream_len - stream_pos;
+}
+uint32_t tud_midi_n_stream_read(uint8_t itf, uint8_t cable, void *buffer,
+                                uint32_t bufsize) {
+  uint32_t n = stream_len - stream_pos;
+  if (n > bufsize) {
+    n = bufsize;
+  }
+  memcpy(buffer, &stream[stream_pos], n);
+  stream_pos += n;
+  return n;
+}
+uint32_t tud_midi_n_stream_write(uint8_t itf, uint8_t cable,
+                                 const uint8_t *buffer, uint32_t bufsize) {
+  return bufsize;
+}
+bool tud_midi_n_packet_write(uint8_t itf, const uint8_t packet[4]) {
+  return true;
+}
+
+#include "../../midi_comm.h"
+
+int ticks = 0;
+int starts = 0;
+int continues = 0;
+int stops = 0;
+int sysex_count = 0;
+int sysex_length = 0;
+uint8_t sysex_data[64];
+
+void on_timing() { ticks++; }
+void on_start() { starts++; }
+void on_continue() { continues++; }
+void on_stop() { stops++; }
+void on_sysex(uint8_t *buffer, int length) {
+  sysex_count++;
+  sysex_length = length;
+  memcpy(sysex_data, buffer, length);
+}
+
+void feed(const uint8_t *data, uint32_t len) {
+  memcpy(stream, data, len);
+  stream_len = len;
+  stream_pos = 0;
+  while (stream_pos < stream_len) {
+    midi_comm_task(on_sysex, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                   on_start, on_continue, on_stop, on_timing, NULL);
+  }
+}
+
+int main() {
+  // a clock tick in the middle of a SysEx fires once and is not stored
+  uint8_t tick_in_sysex[] = {0xF0, 0x7D, 0x01, 0xF8, 0x02, 0x03, 0xF7};
+  feed(tick_in_sysex, sizeof(tick_in_sysex));
+  assert(ticks == 1);
+  assert(sysex_count == 1);
+  assert(sysex_length == 4);
+  uint8_t expected[] = {0x7D, 0x01, 0x02, 0x03};
+  assert(memcmp(sysex_data, expected, sizeof(expected)) == 0);
+  assert(usb_midi_present);
+
+  // transport inside a SysEx, including next to its end
+  uint8_t transport_in_sysex[] = {0xF0, 0xFA, 0x10, 0xFB, 0x11,
+                                  0xF8, 0xFC, 0xF7};
+  feed(transport_in_sysex, sizeof(transport_in_sysex));
+  assert(starts == 1);
+  assert(continues == 1);
+  assert(stops == 1);
+  assert(ticks == 2);
+  assert(sysex_count == 2);
+  assert(sysex_length == 2);
+  assert(sysex_data[0] == 0x10 && sysex_data[1] == 0x11);
+
+  // outside a SysEx the usual path still dispatches
+  uint8_t tick[] = {0xF8};
+  feed(tick, sizeof(tick));
+  assert(ticks == 3);
+
+  printf("midicomm tests passed\n");
+  return 0;
+}
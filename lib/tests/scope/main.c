@@ -0,0 +1,91 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../scope.h"
+
+uint8_t raw[SCOPE_BATCH_MAX_SIZE];
+int16_t samples[SCOPE_BATCH][8];
+
+int main() {
+  Scope scope;
+  float volts[8];
+
+  // free running, a sine and a few jumps round trip exactly
+  Scope_init(&scope);
+  Scope_configure(&scope, SCOPE_FREE, 0xFF, 1, 0, 0, 0);
+  for (uint16_t t = 0; t < 100; t++) {
+    for (uint8_t i = 0; i < 8; i++) {
+      volts[i] = 5.0f * sinf(t * 0.05f * (i + 1));
+    }
+    volts[7] = (t % 10) < 5 ? -5.0f : 10.0f;
+    Scope_sample(&scope, volts);
+  }
+  assert(Scope_available(&scope) == 100);
+  uint16_t total = 0;
+  uint16_t len;
+  while ((len = Scope_encode(&scope, raw)) > 0) {
+    assert(len <= SCOPE_BATCH_MAX_SIZE);
+    int32_t count = Scope_decode(raw, len, samples);
+    assert(count > 0 && count <= SCOPE_BATCH);
+    for (int32_t n = 0; n < count; n++) {
+      uint16_t t = total + n;
+      for (uint8_t i = 0; i < 7; i++) {
+        int16_t want = (int16_t)roundf(5000.0f * sinf(t * 0.05f * (i + 1)));
+        assert(abs(samples[n][i] - want) <= 1);
+      }
+      assert(samples[n][7] == ((t % 10) < 5 ? -5000 : 10000));
+    }
+    total += count;
+  }
+  assert(total == 100);
+  assert(scope.seq == (100 + SCOPE_BATCH - 1) / SCOPE_BATCH);
+
+  // slow signals cost about one byte per sample
+  Scope_configure(&scope, SCOPE_FREE, 0x01, 1, 0, 0, 0);
+  for (uint16_t t = 0; t < SCOPE_BATCH; t++) {
+    volts[0] = t * 0.01f;
+    Scope_sample(&scope, volts);
+  }
+  assert(Scope_encode(&scope, raw) == SCOPE_HEADER + 3 + SCOPE_BATCH - 1);
+
+  // decimation
+  Scope_configure(&scope, SCOPE_FREE, 0xFF, 4, 0, 0, 0);
+  for (uint16_t t = 0; t < 40; t++) {
+    Scope_sample(&scope, volts);
+  }
+  assert(Scope_available(&scope) == 10);
+
+  // rising trigger records length samples from the crossing
+  Scope_configure(&scope, SCOPE_RISING, 0x01, 1, 0, 1000, 8);
+  for (uint16_t t = 0; t < 60; t++) {
+    volts[0] = (t % 20) < 10 ? 0.0f : 2.0f;
+    Scope_sample(&scope, volts);
+  }
+  // crossings at t = 10, 30 and 50
+  assert(Scope_available(&scope) == 24);
+  len = Scope_encode(&scope, raw);
+  assert(raw[2] == 24 && raw[4] == 0);
+  assert(Scope_decode(raw, len, samples) == 24);
+  for (uint8_t n = 0; n < 24; n++) {
+    assert(samples[n][0] == 2000);
+  }
+
+  // a full ring sets the overflow flag
+  Scope_configure(&scope, SCOPE_FREE, 0x01, 1, 0, 0, 0);
+  for (uint16_t t = 0; t < SCOPE_RING + 10; t++) {
+    Scope_sample(&scope, volts);
+  }
+  assert(scope.dropped == 11);
+  Scope_encode(&scope, raw);
+  assert(raw[5] & SCOPE_FLAG_OVERFLOW);
+  Scope_encode(&scope, raw);
+  assert(!(raw[5] & SCOPE_FLAG_OVERFLOW));
+
+  printf("scope tests passed\n");
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../subscription.h"
+
+uint8_t raw[SYSEXBIN_MAX_ENTRIES * SYSEXBIN_ENTRY_SIZE];
+
+// frame adds one voltage per output the way the device does
+int32_t frame(Subscription *sub, float *volts, uint32_t now) {
+  Subscription_begin(sub, raw);
+  for (uint8_t i = 0; i < 8; i++) {
+    if (sub->outputs & (1 << i)) {
+      Subscription_add(sub, &sub->voltage[i], 0, i, SYSEXBIN_STATE_VOLTAGE,
+                       volts[i], SUBSCRIPTION_VOLTAGE_DEADBAND);
+    }
+  }
+  return Subscription_end(sub, now);
+}
+
+int main() {
+  Subscription sub;
+  Subscription_init(&sub);
+  assert(!Subscription_due(&sub, 1000));
+
+  float volts[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+  Subscription_set(&sub, SUBSCRIPTION_VOLTAGES, 0x0F, 20, 0, 1000);
+  // due right away, and the first frame has every subscribed output
+  assert(Subscription_due(&sub, 1000));
+  assert(frame(&sub, volts, 1000) == 4 * SYSEXBIN_ENTRY_SIZE);
+  uint8_t scene, output, param;
+  float val;
+  SysExBin_get_entry(&raw[3 * SYSEXBIN_ENTRY_SIZE], &scene, &output, &param,
+                     &val);
+  assert(output == 3 && param == SYSEXBIN_STATE_VOLTAGE && val == 3.0f);
+
+  // not due again until the period has passed
+  assert(!Subscription_due(&sub, 1010));
+  assert(Subscription_due(&sub, 1020));
+
+  // nothing changed, nothing to send until the keepalive
+  assert(frame(&sub, volts, 1020) == -1);
+  assert(frame(&sub, volts, 1000 + SUBSCRIPTION_KEEPALIVE_MS) == 0);
+
+  // changes below the deadband are dropped, others coalesce into one entry
+  volts[0] += 0.0005f;
+  volts[2] = 2.5f;
+  volts[2] = 2.25f;
+  volts[5] = -1.0f;  // not subscribed
+  assert(frame(&sub, volts, 2100) == SYSEXBIN_ENTRY_SIZE);
+  SysExBin_get_entry(raw, &scene, &output, &param, &val);
+  assert(output == 2 && val == 2.25f);
+
+  // values that do not fit stay pending for the next frame
+  Subscription_set(&sub, SUBSCRIPTION_PARAMS, 0xFF, 50, 0, 3000);
+  int32_t total = 0;
+  for (uint32_t n = 0; n < 4; n++) {
+    Subscription_begin(&sub, raw);
+    for (uint8_t o = 0; o < 8; o++) {
+      for (uint8_t p = 0; p < SYSEXBIN_SCENE_PARAMS; p++) {
+        Subscription_add(&sub, &sub.params[o][p], 1, o, p, o * 100 + p, 0);
+      }
+    }
+    int32_t len = Subscription_end(&sub, 3000 + n * 50);
+    assert(len <= SYSEXBIN_MAX_ENTRIES * SYSEXBIN_ENTRY_SIZE);
+    total += len > 0 ? len : 0;
+  }
+  assert(total == 8 * SYSEXBIN_SCENE_PARAMS * SYSEXBIN_ENTRY_SIZE);
+
+  // a scene change sends every param again
+  Subscription_invalidate_params(&sub);
+  assert(sub.params[7][SYSEXBIN_SCENE_PARAMS - 1] == SUBSCRIPTION_UNSENT);
+
+  // period is clamped, 0 picks the default
+  Subscription_set(&sub, SUBSCRIPTION_GLOBAL, 0, 1, 0, 0);
+  assert(sub.period_ms == SUBSCRIPTION_PERIOD_MIN_MS);
+  Subscription_set(&sub, SUBSCRIPTION_GLOBAL, 0, 0, 0, 0);
+  assert(sub.period_ms == SUBSCRIPTION_PERIOD_DEFAULT_MS);
+
+  printf("subscription tests passed\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../sysexbin.h"
+
+void test_pack() {
+  uint8_t raw[256];
+  uint8_t packed[SYSEXBIN_PACKED_SIZE(256)];
+  uint8_t unpacked[256];
+  for (int len = 0; len <= 256; len++) {
+    for (int i = 0; i < len; i++) {
+      raw[i] = rand() & 0xFF;
+    }
+    uint16_t plen = SysExBin_pack7(raw, len, packed);
+    assert(plen == SYSEXBIN_PACKED_SIZE(len));
+    for (int i = 0; i < plen; i++) {
+      assert((packed[i] & 0x80) == 0);
+    }
+    int32_t ulen = SysExBin_unpack7(packed, plen, unpacked);
+    assert(ulen == len);
+    assert(memcmp(raw, unpacked, len) == 0);
+  }
+  printf("pack7 round trip ok\n");
+}
+
+void test_fixed() {
+  float values[] = {0, 1, -1, 0.5f, -5.0f, 10.0f, 120.0f, 0.001f, 3.14159f};
+  for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    float back = SysExBin_from_fixed(SysExBin_to_fixed(values[i]));
+    assert(fabsf(back - values[i]) <= 1.0f / SYSEXBIN_FIXED_ONE);
+  }
+  assert(SysExBin_to_fixed(1e9f) == INT32_MAX);
+  assert(SysExBin_to_fixed(-1e9f) == INT32_MIN);
+  printf("fixed point ok\n");
+}
+
+void test_frame() {
+  uint8_t raw[SYSEXBIN_ENTRY_SIZE * SYSEXBIN_MAX_ENTRIES];
+  uint8_t frame[SYSEXBIN_HEADER + SYSEXBIN_PACKED_SIZE(sizeof(raw))];
+  uint16_t len = 0;
+  for (int i = 0; i < SYSEXBIN_MAX_ENTRIES; i++) {
+    len += SysExBin_put_entry(&raw[len], i % 8, (i / 8) % 8, i % 24,
+                              (float)i * 0.25f - 5.0f);
+  }
+  uint16_t flen = SysExBin_encode(SYSEXBIN_SET, raw, len, frame);
+  assert(SysExBin_is_frame(frame, flen));
+  for (int i = 0; i < flen; i++) {
+    assert((frame[i] & 0x80) == 0);
+  }
+
+  uint8_t command;
+  uint8_t decoded[sizeof(raw)];
+  int32_t dlen = SysExBin_decode(frame, flen, &command, decoded);
+  assert(command == SYSEXBIN_SET);
+  assert(dlen == len);
+  for (int i = 0; i < SYSEXBIN_MAX_ENTRIES; i++) {
+    uint8_t scene, output, param;
+    float val;
+    SysExBin_get_entry(&decoded[i * SYSEXBIN_ENTRY_SIZE], &scene, &output,
+                       &param, &val);
+    assert(scene == i % 8);
+    assert(output == (i / 8) % 8);
+    assert(param == i % 24);
+    assert(val == (float)i * 0.25f - 5.0f);
+  }
+  printf("%d entries: %d raw bytes, %d on the wire\n", SYSEXBIN_MAX_ENTRIES,
+         len, flen + 2);
+
+  // wrong version and text commands are rejected
+  frame[1] = SYSEXBIN_VERSION + 1;
+  assert(SysExBin_decode(frame, flen, &command, decoded) < 0);
+  const char *text = "0_0_1_2.5";
+  assert(!SysExBin_is_frame((const uint8_t *)text, strlen(text)));
+  // a byte with the high bit set is not valid 7-bit data
+  frame[1] = SYSEXBIN_VERSION;
+  frame[5] = 0x80;
+  assert(SysExBin_decode(frame, flen, &command, decoded) < 0);
+  printf("frame ok\n");
+}
+
+void test_bulk() {
+  const char *check = "123456789";
+  assert(SysExBin_crc32((const uint8_t *)check, 9) == 0xCBF43926);
+
+  // a whole scene fits one frame inside the 1024 byte receive buffer
+  uint8_t raw[SYSEXBIN_SCENE_SIZE];
+  uint8_t frame[SYSEXBIN_HEADER + SYSEXBIN_PACKED_SIZE(SYSEXBIN_SCENE_SIZE)];
+  assert(sizeof(frame) <= 1024);
+  uint16_t len = 0;
+  raw[len++] = 3;
+  raw[len++] = SYSEXBIN_SCENE_PARAMS;
+  for (int i = 0; i < 8 * SYSEXBIN_SCENE_PARAMS; i++) {
+    SysExBin_put_fixed(&raw[len], (float)i / 8.0f);
+    len += 4;
+  }
+  len = SysExBin_seal(raw, len);
+  assert(len == SYSEXBIN_SCENE_SIZE);
+  uint16_t flen = SysExBin_encode(SYSEXBIN_SCENE, raw, len, frame);
+
+  uint8_t command;
+  uint8_t decoded[SYSEXBIN_SCENE_SIZE];
+  int32_t dlen = SysExBin_decode(frame, flen, &command, decoded);
+  assert(command == SYSEXBIN_SCENE && dlen == SYSEXBIN_SCENE_SIZE);
+  assert(SysExBin_check(decoded, dlen));
+  for (int i = 0; i < 8 * SYSEXBIN_SCENE_PARAMS; i++) {
+    assert(SysExBin_get_fixed(&decoded[2 + i * 4]) == (float)i / 8.0f);
+  }
+  // any corrupted byte is caught
+  decoded[100] ^= 0x01;
+  assert(!SysExBin_check(decoded, dlen));
+
+  // calibration floats survive bit for bit
+  float slope = 0.98765432f;
+  SysExBin_put_float(raw, slope);
+  assert(SysExBin_get_float(raw) == slope);
+  printf("scene frame: %d bytes on the wire\n", flen + 2);
+}
+
+// test_code_vector builds a script download the way the firmware sends it.
+// The same frames are checked by dev/yoctocore-fs/midicom/sysexbin_test.go
+// so both ends of the codec agree on the bytes.
+void test_code_vector() {
+  const uint8_t header_frame[] = {0x7D, 0x01, 0x0D, 0x00, 0x02, 0x05,
+                                  0x00, 0x0B, 0x00, 0x00, 0x00, 0x07,
+                                  0x44, 0x4D, 0x75, 0x46};
+  const uint8_t part_frame[] = {0x7D, 0x01, 0x0E, 0x00, 0x02, 0x05, 0x00,
+                                0x00, 0x70, 0x72, 0x69, 0x00, 0x6E, 0x74,
+                                0x28, 0x22, 0x68, 0x69, 0x22, 0x00, 0x29};
+  const char *code = "print(\"hi\")";
+  uint16_t len = strlen(code);
+  uint8_t frame[64];
+
+  uint8_t header[11] = {2, 5, 0};
+  SysExBin_put_u32(&header[3], len);
+  SysExBin_put_u32(&header[7], SysExBin_crc32((const uint8_t *)code, len));
+  uint16_t flen = SysExBin_encode(SYSEXBIN_CODE_HEADER, header, 11, frame);
+  assert(flen == sizeof(header_frame));
+  assert(memcmp(frame, header_frame, flen) == 0);
+
+  uint8_t part[4 + 16] = {2, 5, 0, 0};
+  memcpy(&part[4], code, len);
+  flen = SysExBin_encode(SYSEXBIN_CODE_PART, part, 4 + len, frame);
+  assert(flen == sizeof(part_frame));
+  assert(memcmp(frame, part_frame, flen) == 0);
+  printf("code vector ok\n");
+}
+
+int main() {
+  srand(1);
+  test_pack();
+  test_fixed();
+  test_frame();
+  test_bulk();
+  test_code_vector();
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../usbvendor.h"
+
+int received = 0;
+uint8_t last_command;
+uint16_t last_len;
+uint8_t last_payload[USBVENDOR_MAX_PAYLOAD];
+
+void on_frame(uint8_t command, uint8_t *payload, uint16_t len) {
+  received++;
+  last_command = command;
+  last_len = len;
+  memcpy(last_payload, payload, len);
+}
+
+// frame builds a frame the way UsbVendor_send writes it
+uint16_t frame(uint8_t *out, uint8_t command, const uint8_t *payload,
+               uint16_t len) {
+  out[0] = USBVENDOR_SYNC;
+  out[1] = command;
+  out[2] = len & 0xFF;
+  out[3] = len >> 8;
+  memcpy(&out[USBVENDOR_HEADER], payload, len);
+  SysExBin_put_u32(&out[USBVENDOR_HEADER + len],
+                   SysExBin_crc32(&out[1], USBVENDOR_HEADER - 1 + len));
+  return USBVENDOR_OVERHEAD + len;
+}
+
+int main() {
+  srand(1);
+  UsbVendor vendor;
+  UsbVendor_init(&vendor);
+  uint8_t payload[USBVENDOR_MAX_PAYLOAD];
+  uint8_t buffer[USBVENDOR_MAX_PAYLOAD + USBVENDOR_OVERHEAD];
+
+  // frames of every size, fed in random pieces with noise in between
+  for (int len = 0; len <= USBVENDOR_MAX_PAYLOAD; len += 7) {
+    for (int i = 0; i < len; i++) {
+      payload[i] = rand() & 0xFF;
+    }
+    uint16_t n = frame(buffer, len & 0x7F, payload, len);
+    uint8_t noise[3] = {0x00, 0x13, 0x42};
+    UsbVendor_feed(&vendor, noise, sizeof(noise), on_frame);
+    for (uint16_t i = 0; i < n;) {
+      uint16_t piece = 1 + rand() % 64;
+      if (piece > n - i) {
+        piece = n - i;
+      }
+      UsbVendor_feed(&vendor, &buffer[i], piece, on_frame);
+      i += piece;
+    }
+    assert(last_command == (len & 0x7F));
+    assert(last_len == len);
+    assert(memcmp(last_payload, payload, len) == 0);
+  }
+  int good = received;
+  printf("%d frames received\n", good);
+
+  // a corrupted frame is dropped and the next one still gets through
+  uint16_t n = frame(buffer, 1, payload, 100);
+  buffer[50] ^= 0x01;
+  UsbVendor_feed(&vendor, buffer, n, on_frame);
+  assert(received == good && vendor.errors == 1);
+  n = frame(buffer, 2, payload, 100);
+  UsbVendor_feed(&vendor, buffer, n, on_frame);
+  assert(received == good + 1 && last_command == 2);
+
+  // an oversize length is refused without waiting for its payload
+  uint8_t oversize[4] = {USBVENDOR_SYNC, 1, 0xFF, 0xFF};
+  UsbVendor_feed(&vendor, oversize, sizeof(oversize), on_frame);
+  assert(vendor.errors == 2 && vendor.index == 0);
+  printf("errors ok\n");
+  return 0;
+}
@@ -78,20 +78,24 @@ uint8_t const* tud_descriptor_device_cb(void) {
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
-#if CFG_TUD_CDC
 enum
   {
+#if CFG_TUD_CDC
     ITF_NUM_CDC            = 0,
     ITF_NUM_CDC_DATA,
+#endif
     ITF_NUM_MIDI,
     ITF_NUM_MIDI_STREAMING,
+#if CFG_TUD_VENDOR
+    ITF_NUM_VENDOR,
+#endif
+#if CFG_TUD_MSC
+    ITF_NUM_MSC,
+#endif
     ITF_NUM_TOTAL
   };
-#else
-enum { ITF_NUM_MIDI = 0, ITF_NUM_MIDI_STREAMING, ITF_NUM_TOTAL };
-#endif
 
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN)
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN + CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN + CFG_TUD_MSC * TUD_MSC_DESC_LEN)
 
 /* #if CFG_TUSB_MCU == OPT_MCU_LPC175X_6X ||                            \
  *     CFG_TUSB_MCU == OPT_MCU_LPC177X_8X || CFG_TUSB_MCU == OPT_MCU_LPC40XX
@@ -108,6 +112,16 @@ enum { ITF_NUM_MIDI = 0, ITF_NUM_MIDI_STREAMING, ITF_NUM_TOTAL };
 #define EPNUM_CDC_OUT   0x02
 #define EPNUM_CDC_IN    0x82
 
+#define EPNUM_VENDOR_OUT 0x05
+#define EPNUM_VENDOR_IN  0x85
+
+#define EPNUM_MSC_OUT 0x06
+#define EPNUM_MSC_IN  0x86
+
+// string index of the vendor interface, after the CDC one if there is one
+#define STRID_VENDOR (4 + CFG_TUD_CDC)
+#define STRID_MSC (4 + CFG_TUD_CDC + CFG_TUD_VENDOR)
+
 uint8_t const desc_fs_configuration[] = {
   // Config number, interface count, string index, total length, attribute,
   // power in mA
@@ -120,7 +134,18 @@ uint8_t const desc_fs_configuration[] = {
 #endif
 
   // Interface number, string index, EP Out & EP In address, EP size
-  TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI, 0x80 | EPNUM_MIDI, 64)};
+  TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI, 0x80 | EPNUM_MIDI, 64),
+
+#if CFG_TUD_VENDOR
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STRID_VENDOR, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 64),
+#endif
+
+#if CFG_TUD_MSC
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, STRID_MSC, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+#endif
+};
 
 #if TUD_OPT_HIGH_SPEED
 uint8_t const desc_hs_configuration[] = {
@@ -135,7 +160,18 @@ uint8_t const desc_hs_configuration[] = {
 #endif
 
   // Interface number, string index, EP Out & EP In address, EP size
-  TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI, 0x80 | EPNUM_MIDI, 512)};
+  TUD_MIDI_DESCRIPTOR(ITF_NUM_MIDI, 0, EPNUM_MIDI, 0x80 | EPNUM_MIDI, 512),
+
+#if CFG_TUD_VENDOR
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STRID_VENDOR, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 512),
+#endif
+
+#if CFG_TUD_MSC
+  // Interface number, string index, EP Out & EP In address, EP size
+  TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, STRID_MSC, EPNUM_MSC_OUT, EPNUM_MSC_IN, 512),
+#endif
+};
 #endif
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -178,6 +214,12 @@ char const* string_desc_arr[] = {
 #if CFG_TUD_CDC
   "Yoctocore CDC Device", // 4: CDC Interface
 #endif
+#if CFG_TUD_VENDOR
+  "Yoctocore Data", // STRID_VENDOR: Vendor Interface
+#endif
+#if CFG_TUD_MSC
+  "Yoctocore SD Card", // STRID_MSC: Mass Storage Interface
+#endif
 };
 
 static uint16_t _desc_str[32];
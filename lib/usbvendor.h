@@ -0,0 +1,118 @@
+#ifndef LIB_USBVENDOR_H
+#define LIB_USBVENDOR_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sysexbin.h"
+
+// UsbVendor carries editor traffic over a USB vendor bulk interface so
+// transfers and telemetry do not share the MIDI endpoint with notes and
+// clock. Data is 8-bit, so there is no 7-bit packing. A frame is
+//
+//   0xA5 <command> <length u16> <payload> <crc32 u32>
+//
+// little endian, with the crc over command, length and payload. Commands
+// and payloads are the same as the binary SysEx ones (sysexbin.h). A frame
+// with a bad crc is dropped and the parser looks for the next 0xA5.
+
+#define USBVENDOR_SYNC 0xA5
+#define USBVENDOR_HEADER 4
+#define USBVENDOR_MAX_PAYLOAD 1024
+#define USBVENDOR_OVERHEAD (USBVENDOR_HEADER + SYSEXBIN_CRC_SIZE)
+
+typedef void (*usbvendor_callback)(uint8_t command, uint8_t *payload,
+                                   uint16_t len);
+
+typedef struct UsbVendor {
+  uint8_t buffer[USBVENDOR_HEADER + USBVENDOR_MAX_PAYLOAD + SYSEXBIN_CRC_SIZE];
+  uint16_t index;
+  uint16_t len;
+  uint32_t frames;
+  uint32_t errors;
+} UsbVendor;
+
+UsbVendor usbvendor;
+
+void UsbVendor_init(UsbVendor *self) {
+  self->index = 0;
+  self->len = 0;
+  self->frames = 0;
+  self->errors = 0;
+}
+
+// UsbVendor_feed runs the frame parser over received bytes.
+void UsbVendor_feed(UsbVendor *self, const uint8_t *data, uint32_t n,
+                    usbvendor_callback callback) {
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t b = data[i];
+    if (self->index == 0 && b != USBVENDOR_SYNC) {
+      continue;
+    }
+    self->buffer[self->index++] = b;
+    if (self->index == USBVENDOR_HEADER) {
+      self->len = self->buffer[2] | (self->buffer[3] << 8);
+      if (self->len > USBVENDOR_MAX_PAYLOAD) {
+        self->errors++;
+        self->index = 0;
+      }
+    } else if (self->index == USBVENDOR_OVERHEAD + self->len) {
+      uint16_t end = USBVENDOR_HEADER + self->len;
+      self->index = 0;
+      if (SysExBin_get_u32(&self->buffer[end]) !=
+          SysExBin_crc32(&self->buffer[1], end - 1)) {
+        self->errors++;
+        continue;
+      }
+      self->frames++;
+      if (callback != NULL) {
+        callback(self->buffer[1], &self->buffer[USBVENDOR_HEADER], self->len);
+      }
+    }
+  }
+}
+
+#if CFG_TUD_VENDOR
+// UsbVendor_task reads whatever the host sent and hands over whole frames.
+void UsbVendor_task(UsbVendor *self, usbvendor_callback callback) {
+  if (!tud_vendor_mounted()) {
+    self->index = 0;
+    return;
+  }
+  uint8_t data[64];
+  while (tud_vendor_available()) {
+    uint32_t n = tud_vendor_read(data, sizeof(data));
+    if (n == 0) {
+      break;
+    }
+    UsbVendor_feed(self, data, n, callback);
+  }
+}
+
+// UsbVendor_room is true when a frame with len payload bytes can be written
+// without blocking.
+bool UsbVendor_room(uint16_t len) {
+  return tud_vendor_mounted() &&
+         tud_vendor_write_available() >= USBVENDOR_OVERHEAD + len;
+}
+
+// UsbVendor_send writes a whole frame or nothing.
+bool UsbVendor_send(uint8_t command, const uint8_t *payload, uint16_t len) {
+  if (len > USBVENDOR_MAX_PAYLOAD || !UsbVendor_room(len)) {
+    return false;
+  }
+  uint8_t header[USBVENDOR_HEADER] = {USBVENDOR_SYNC, command, len & 0xFF,
+                                      len >> 8};
+  uint8_t crc[SYSEXBIN_CRC_SIZE];
+  SysExBin_put_u32(crc, SysExBin_crc32_update(
+                            SysExBin_crc32(&header[1], USBVENDOR_HEADER - 1),
+                            payload, len));
+  tud_vendor_write(header, sizeof(header));
+  tud_vendor_write(payload, len);
+  tud_vendor_write(crc, sizeof(crc));
+  tud_vendor_write_flush();
+  return true;
+}
+#endif
+
+#endif
@@ -2,15 +2,24 @@
 #define LIB_YOCTOCORE_H 1
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "adsr.h"
+#include "binlog.h"
+#include "codedownload.h"
+#include "codeupload.h"
+#include "cvstream.h"
 #include "dac.h"
 #include "lfo.h"
+#include "scope.h"
 #include "slew.h"
+#include "subscription.h"
+#include "sysexbin.h"
 #include "taptempo.h"
+#include "usbvendor.h"
 #include "utils.h"
 
 #define MODE_NOTE 0
@@ -99,6 +108,10 @@ typedef struct Out {
   bool tuning;
   float voltage_calibration_intercept;
   float voltage_calibration_slope;
+  // voltages measured at each point of a calibration table, used instead of
+  // the slope and intercept when calibration_table is set
+  float calibration_points[DACCODE_POINTS];
+  bool calibration_table;
   int8_t mode_last;
   bool code_updated;
   bool clock_disabled;
@@ -116,9 +129,35 @@ typedef struct Yoctocore {
   // debounces
   uint32_t debounce_save;
   float global_tempo;
+  // send 24 PPQN clock at the global tempo instead of following
+  bool clock_master;
+  // outputs that dither their DAC codes when they hold pitches
+  uint8_t dither;
   uint32_t yoctocore_getting;
+  // bulk restore staged until the next pass of the main loop
+  float bulk_values[8][SYSEXBIN_SCENE_PARAMS];
+  int8_t bulk_scene;
+  bool bulk_calibration;
+  float bulk_slope[8];
+  float bulk_intercept[8];
+  // calibration table points sent by calpt, applied by calset
+  float calibration_staged[8][DACCODE_POINTS];
+  // frames of a bulk dump still to send, 8 is the calibration
+  int8_t dump_next;
+  int8_t dump_last;
 } Yoctocore;
 
+// the one code upload and download that can be in progress
+CodeUpload code_upload;
+CodeDownload code_download;
+// what the editor subscribed to
+Subscription subscription;
+// voltage scope fed by the control tick
+Scope scope;
+// host streamed voltages played out by the control tick
+CvStream cvstream;
+uint8_t cvstream_batches = 0;
+
 void Yoctocore_init(Yoctocore *self) {
   for (uint8_t output = 0; output < 8; output++) {
     for (uint8_t scene = 0; scene < 8; scene++) {
@@ -170,92 +209,56 @@ void Yoctocore_init(Yoctocore *self) {
     self->out[output].code_updated = false;
     self->out[output].clock_disabled = false;
     self->out[output].lfo_disabled = false;
+    self->out[output].calibration_table = false;
     TapTempo_init(&self->out[output].taptempo);
   }
   self->debounce_save = 0;
   self->i = 0;
   self->global_tempo = 120;
+  self->clock_master = false;
+  self->dither = 0;
+  self->bulk_scene = -1;
+  self->bulk_calibration = false;
+  self->dump_next = -1;
+  self->dump_last = -1;
+  CodeUpload_init(&code_upload);
+  CodeDownload_init(&code_download);
+  Subscription_init(&subscription);
+  Scope_init(&scope);
+  CvStream_init(&cvstream);
 }
 
 void Yoctocore_schedule_save(Yoctocore *self) {
   self->debounce_save = to_ms_since_boot(get_absolute_time());
 }
 
-char *code_added = NULL;
-size_t code_added_len = 0;
-
+// Yoctocore_add_code handles the text upload (LN/LA/LE chunks), which has no
+// sequence numbers or crc and streams through the same temp file.
 void Yoctocore_add_code(Yoctocore *self, uint8_t scene, uint8_t output,
                         char *code, uint16_t code_len, bool append,
                         bool finish) {
-  if (code_len == 0) {
-    return;
-  }
-
-  if (code_added == NULL || !append) {
-    if (code_added != NULL) {
-      free(code_added);
-      code_added = NULL;
-    }
-    // Allocate memory and copy the new code
-    code_added = (char *)malloc(code_len);
-    if (code_added == NULL) {
-      // Handle memory allocation failure
-      printf("failed to allocate memory\n");
-      return;
-    }
-    memcpy(code_added, code, code_len);
-    code_added_len = code_len;
-  } else {
-    // Append the new code to the existing code
-    size_t new_code_len = code_added_len + code_len;
-    char *new_code = (char *)malloc(new_code_len + 1);
-    if (new_code == NULL) {
-      // Handle memory allocation failure
-      printf("failed to allocate memory\n");
+  if (!append) {
+    if (!CodeUpload_begin(&code_upload, scene, output, 0, 0)) {
       return;
     }
-    memcpy(new_code, code_added, code_added_len);
-    memcpy(new_code + code_added_len, code, code_len);
-    free(code_added);
-    code_added = new_code;
-    if (new_code_len > 0) {
-      // null terminate
-      code_added[new_code_len] = '\0';
-    }
-    code_added_len = new_code_len;
+  } else if (!code_upload.active || code_upload.scene != scene ||
+             code_upload.output != output) {
+    printf("[%d%d] code chunk without start\n", scene, output);
+    return;
+  }
+  if (code_len > 0 &&
+      CodeUpload_write(&code_upload, code_upload.next_seq, (uint8_t *)code,
+                       code_len) != CODEUPLOAD_OK) {
+    return;
   }
 
   if (finish) {
-    // write to disk
-    FRESULT fr;
-    FIL file;
-    UINT bw;
-    char fname[32];
-    snprintf(fname, sizeof(fname), "scene%d_output%d.lua", scene + 1,
-             output + 1);
-    fr = f_open(&file, fname, FA_WRITE | FA_CREATE_ALWAYS);
-    if (fr != FR_OK) {
-      printf("f_open error: %s (%d): %s\n", FRESULT_str(fr), fr, fname);
-      free(code_added);
-      code_added = NULL;
-      return;
-    }
-    fr = f_write(&file, code_added, code_added_len, &bw);
-    if (fr != FR_OK || bw != code_added_len) {
-      printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
-      free(code_added);
-      code_added = NULL;
+    if (CodeUpload_finish(&code_upload) != CODEUPLOAD_OK) {
       return;
     }
-    fr = f_close(&file);
-    if (fr != FR_OK) {
-      printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
-    }
-    free(code_added);
-    code_added = NULL;
     // set code to be updated
     self->out[output].code_updated = true;
-    printf("[%d%d] code %d bytes\n", scene, output, code_added_len);
+    printf("[%d%d] code %" PRIu32 " bytes\n", scene, output, code_upload.len);
   }
 }
 
@@ -268,6 +271,7 @@ bool Yoctocore_do_load_code(Yoctocore *self, uint8_t scene, uint8_t output,
 
   // Create the filename (1-indexed)
   snprintf(fname, sizeof(fname), "scene%d_output%d.lua", scene + 1, output + 1);
+  CodeUpload_recover(fname);
 
   // Open the file
   fr = f_open(&file, fname, FA_READ);
@@ -320,65 +324,16 @@ bool Yoctocore_do_load_code(Yoctocore *self, uint8_t scene, uint8_t output,
 }
 
 #define CODE_CHUNK_SIZE \
-  36  // Total buffer size including "LS"/"LE"/"LN", scene, and output
+  256  // Total buffer size including "LS"/"LE"/"LN", scene, and output
 
+// Yoctocore_print_code starts sending a script as LS/LN/LE text chunks,
+// Yoctocore_download_task streams them out of the SD card.
 void Yoctocore_print_code(Yoctocore *self, uint8_t scene, uint8_t output) {
-  // Load code
-  char *code;
-  FSIZE_t code_len;
-  if (!Yoctocore_do_load_code(self, scene, output, &code, &code_len)) {
-    return;
-  }
-
-  uint16_t i = 0;
-
-  while (i < code_len) {
-    // Create a buffer with CODE_CHUNK_SIZE
-    char buffer[CODE_CHUNK_SIZE];
-    memset(buffer, 0, sizeof(buffer));
-
-    // Determine prefix: LS, LE, or LN
-    if (i == 0 && code_len - i <= (CODE_CHUNK_SIZE - 4)) {
-      // First and last chunk
-      buffer[0] = 'L';
-      buffer[1] = 'E';
-    } else if (i == 0) {
-      // First chunk
-      buffer[0] = 'L';
-      buffer[1] = 'S';
-    } else if (code_len - i <= (CODE_CHUNK_SIZE - 4)) {
-      // Last chunk
-      buffer[0] = 'L';
-      buffer[1] = 'E';
-    } else {
-      // Intermediate chunk
-      buffer[0] = 'L';
-      buffer[1] = 'N';
-    }
-
-    // Add the scene and output identifiers
-    buffer[2] = '0' + scene;
-    buffer[3] = '0' + output;
-
-    // Calculate the chunk size for code data
-    uint16_t chunk_size = (code_len - i > (CODE_CHUNK_SIZE - 4))
-                              ? (CODE_CHUNK_SIZE - 4)
-                              : (code_len - i);
-
-    // Copy code data into the buffer, starting after the header
-    memcpy(&buffer[4], &code[i], chunk_size);
-    i += chunk_size;
-
-#ifdef INCLUDE_MIDI
-    // Send the buffer as SysEx
-    send_buffer_as_sysex(
-        buffer,
-        4 + chunk_size);  // 4 for "LS"/"LE"/"LN", scene, output + chunk_size
-#endif
+  code_download.batch_next = -1;
+  if (CodeDownload_start(&code_download, scene, output, false) !=
+      CODEDOWNLOAD_OK) {
+    printf("[%d%d] no code\n", scene, output);
   }
-  // free code
-  free(code);
-  code = NULL;
 }
 
 void Yoctocore_set(Yoctocore *self, uint8_t scene, uint8_t output,
@@ -565,6 +520,23 @@ bool Yoctcoroe_do_save(Yoctocore *self) {
     }
   }
 
+  // global settings are appended so older savefiles still load
+  fr = f_write(&file, &self->global_tempo, sizeof(float), &bw);
+  if (FR_OK != fr) {
+    printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+    return false;
+  }
+  fr = f_write(&file, &self->clock_master, sizeof(bool), &bw);
+  if (FR_OK != fr) {
+    printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+    return false;
+  }
+  fr = f_write(&file, &self->dither, sizeof(uint8_t), &bw);
+  if (FR_OK != fr) {
+    printf("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+    return false;
+  }
+
   fr = f_close(&file);
   if (FR_OK != fr) {
     printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -641,6 +613,24 @@ bool Yoctocore_load(Yoctocore *self) {
     }
   }
 
+  // global settings (missing in older savefiles)
+  float global_tempo;
+  fr = f_read(&file, &global_tempo, sizeof(float), &br);
+  if (FR_OK == fr && br == sizeof(float) && global_tempo >= 20 &&
+      global_tempo <= 400) {
+    self->global_tempo = global_tempo;
+    bool clock_master;
+    fr = f_read(&file, &clock_master, sizeof(bool), &br);
+    if (FR_OK == fr && br == sizeof(bool)) {
+      self->clock_master = clock_master;
+    }
+    uint8_t dither;
+    fr = f_read(&file, &dither, sizeof(uint8_t), &br);
+    if (FR_OK == fr && br == sizeof(uint8_t)) {
+      self->dither = dither;
+    }
+  }
+
   fr = f_close(&file);
   if (FR_OK != fr) {
     printf("f_close error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -694,47 +684,103 @@ void Yoctocore_process_sysex(Yoctocore *self, uint8_t *buffer) {
   }
 }
 
-bool Yoctocore_set_calibration(Yoctocore *self, int output,
-                               float voltage_calibration_slope,
-                               float voltage_calibration_intercept) {
-  self->out[output].voltage_calibration_slope = voltage_calibration_slope;
-  self->out[output].voltage_calibration_intercept =
-      voltage_calibration_intercept;
+// all the calibrations are kept in one file that is read in one go, the
+// calibration<N> files of older firmware are read if it is missing
+#define CALIBRATION_FILE "calibration"
+#define CALIBRATION_VERSION 1
+
+typedef struct CalibrationFile {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t points;
+  float slope[8];
+  float intercept[8];
+  uint8_t table[8];
+  float table_points[8][DACCODE_POINTS];
+  uint32_t crc;
+} CalibrationFile;
+
+CalibrationFile calibration_file;
+
+bool Yoctocore_save_calibrations(Yoctocore *self) {
+  CalibrationFile *cf = &calibration_file;
+  memset(cf, 0, sizeof(CalibrationFile));
+  cf->magic = MAGIC_UINT16;
+  cf->version = CALIBRATION_VERSION;
+  cf->points = DACCODE_POINTS;
+  for (uint8_t i = 0; i < 8; i++) {
+    cf->slope[i] = self->out[i].voltage_calibration_slope;
+    cf->intercept[i] = self->out[i].voltage_calibration_intercept;
+    cf->table[i] = self->out[i].calibration_table;
+    memcpy(cf->table_points[i], self->out[i].calibration_points,
+           sizeof(cf->table_points[i]));
+  }
+  cf->crc = SysExBin_crc32((const uint8_t *)cf, offsetof(CalibrationFile, crc));
+
   FRESULT fr;
   FIL file;
   UINT bw;
-  char fname[32];
-  sprintf(fname, "calibration%d", output);
-
-  fr = f_open(&file, fname, FA_WRITE | FA_CREATE_ALWAYS);
+  fr = f_open(&file, CALIBRATION_FILE, FA_WRITE | FA_CREATE_ALWAYS);
   if (FR_OK != fr) {
-    printf("f_open set: %s (%d) (%s)\n", FRESULT_str(fr), fr, fname);
+    printf("f_open set: %s (%d) (%s)\n", FRESULT_str(fr), fr,
+           CALIBRATION_FILE);
     return false;
   }
-  uint32_t total_bytes_written = 0;
-
-  // write the calibration values
-  fr = f_write(&file, &voltage_calibration_slope, sizeof(float), &bw);
-  if (FR_OK != fr) {
+  fr = f_write(&file, cf, sizeof(CalibrationFile), &bw);
+  if (FR_OK != fr || bw != sizeof(CalibrationFile)) {
     printf("f_write set: %s (%d)\n", FRESULT_str(fr), fr);
+    f_close(&file);
     return false;
   }
-  fr = f_write(&file, &voltage_calibration_intercept, sizeof(float), &bw);
+  fr = f_close(&file);
   if (FR_OK != fr) {
-    printf("f_write set: %s (%d)\n", FRESULT_str(fr), fr);
+    printf("f_close set: %s (%d)\n", FRESULT_str(fr), fr);
     return false;
   }
+  return true;
+}
 
-  fr = f_close(&file);
-  if (FR_OK != fr) {
-    printf("f_close set: %s (%d)\n", FRESULT_str(fr), fr);
+bool Yoctocore_set_calibration(Yoctocore *self, int output,
+                               float voltage_calibration_slope,
+                               float voltage_calibration_intercept) {
+  self->out[output].voltage_calibration_slope = voltage_calibration_slope;
+  self->out[output].voltage_calibration_intercept =
+      voltage_calibration_intercept;
+  self->out[output].calibration_table = false;
+  if (!Yoctocore_save_calibrations(self)) {
     return false;
   }
   printf("set cali for %d\n", output);
   return true;
 }
 
-void Yoctocore_get_calibrations(Yoctocore *self) {
+// Yoctocore_set_calibration_points calibrates an output with a table of the
+// voltages measured at each raw setpoint. The slope and intercept become
+// the line through the ends of the table, for the binary dump and older
+// tools.
+bool Yoctocore_set_calibration_points(Yoctocore *self, int output,
+                                      const float *measured) {
+  if (!DacCode_points_valid(measured)) {
+    printf("cali table for %d is not a measurement\n", output);
+    return false;
+  }
+  Out *out = &self->out[output];
+  memcpy(out->calibration_points, measured, sizeof(out->calibration_points));
+  out->calibration_table = true;
+  out->voltage_calibration_slope =
+      (measured[DACCODE_POINTS - 1] - measured[0]) / (DACCODE_POINTS - 1);
+  out->voltage_calibration_intercept =
+      measured[0] - out->voltage_calibration_slope * DACCODE_POINT_MIN;
+  if (!Yoctocore_save_calibrations(self)) {
+    return false;
+  }
+  printf("set cali table for %d\n", output);
+  return true;
+}
+
+// Yoctocore_get_calibrations_legacy reads the per output files of older
+// firmware, which hold only a slope and intercept.
+bool Yoctocore_get_calibrations_legacy(Yoctocore *self) {
   for (uint8_t i = 0; i < 8; i++) {
     FRESULT fr;
     FIL file;
@@ -745,26 +791,634 @@ void Yoctocore_get_calibrations(Yoctocore *self) {
     fr = f_open(&file, fname, FA_READ);
     if (FR_OK != fr) {
       printf("f_open: %s (%d) %s\n", FRESULT_str(fr), fr, fname);
-      return;
+      return false;
     }
     fr = f_read(&file, &self->out[i].voltage_calibration_slope, sizeof(float),
                 &br);
     if (FR_OK != fr) {
       printf("f_read get: %s (%d)\n", FRESULT_str(fr), fr);
-      return;
+      f_close(&file);
+      return false;
     }
     fr = f_read(&file, &self->out[i].voltage_calibration_intercept,
                 sizeof(float), &br);
     if (FR_OK != fr) {
       printf("f_read get: %s (%d)\n", FRESULT_str(fr), fr);
-      return;
+      f_close(&file);
+      return false;
     }
+    self->out[i].calibration_table = false;
     fr = f_close(&file);
     if (FR_OK != fr) {
       printf("f_close get: %s (%d)\n", FRESULT_str(fr), fr);
+      return false;
+    }
+  }
+  return true;
+}
+
+void Yoctocore_get_calibrations(Yoctocore *self) {
+  CalibrationFile *cf = &calibration_file;
+  FRESULT fr;
+  FIL file;
+  UINT br;
+  fr = f_open(&file, CALIBRATION_FILE, FA_READ);
+  if (FR_OK != fr) {
+    // older firmware, move its calibration over to the single file
+    if (Yoctocore_get_calibrations_legacy(self)) {
+      Yoctocore_save_calibrations(self);
+    }
+    return;
+  }
+  fr = f_read(&file, cf, sizeof(CalibrationFile), &br);
+  f_close(&file);
+  if (FR_OK != fr || br != sizeof(CalibrationFile)) {
+    printf("f_read get: %s (%d)\n", FRESULT_str(fr), fr);
+    return;
+  }
+  if (cf->magic != MAGIC_UINT16 || cf->version != CALIBRATION_VERSION ||
+      cf->points != DACCODE_POINTS ||
+      cf->crc != SysExBin_crc32((const uint8_t *)cf,
+                                offsetof(CalibrationFile, crc))) {
+    printf("calibration file is corrupt\n");
+    return;
+  }
+  for (uint8_t i = 0; i < 8; i++) {
+    Out *out = &self->out[i];
+    out->voltage_calibration_slope = cf->slope[i];
+    out->voltage_calibration_intercept = cf->intercept[i];
+    memcpy(out->calibration_points, cf->table_points[i],
+           sizeof(out->calibration_points));
+    out->calibration_table =
+        cf->table[i] && DacCode_points_valid(out->calibration_points);
+  }
+}
+
+// scratch for binary frames, sized for the largest (a whole scene)
+uint8_t yoctocore_bin_raw[SYSEXBIN_SCENE_SIZE];
+uint8_t yoctocore_bin_frame[SYSEXBIN_HEADER +
+                            SYSEXBIN_PACKED_SIZE(SYSEXBIN_SCENE_SIZE)];
+
+// binary replies go back the way the last command came in
+#define YOCTOCORE_TRANSPORT_SYSEX 0
+#define YOCTOCORE_TRANSPORT_VENDOR 1
+uint8_t yoctocore_transport = YOCTOCORE_TRANSPORT_SYSEX;
+// binary log records are sent to the host while enabled
+bool binlog_streaming = false;
+uint8_t binlog_transport = YOCTOCORE_TRANSPORT_SYSEX;
+
+void Yoctocore_send_binary(uint8_t command, uint8_t *raw, uint16_t len) {
+#if CFG_TUD_VENDOR
+  if (yoctocore_transport == YOCTOCORE_TRANSPORT_VENDOR) {
+    UsbVendor_send(command, raw, len);
+    return;
+  }
+#endif
+#ifdef INCLUDE_MIDI
+  send_buffer_as_sysex(
+      (char *)yoctocore_bin_frame,
+      SysExBin_encode(command, raw, len, yoctocore_bin_frame));
+#endif
+}
+
+void Yoctocore_send_ack(uint8_t command, uint8_t scene, uint8_t status) {
+  uint8_t ack[3] = {command, scene, status};
+  Yoctocore_send_binary(SYSEXBIN_ACK, ack, sizeof(ack));
+}
+
+void Yoctocore_send_code_ack(uint8_t status) {
+  uint8_t ack[3] = {code_upload.next_seq & 0xFF, code_upload.next_seq >> 8,
+                    status};
+  Yoctocore_send_binary(SYSEXBIN_CODE_ACK, ack, sizeof(ack));
+}
+
+void Yoctocore_send_code_header(uint8_t status) {
+  uint8_t header[11] = {code_download.scene, code_download.output, status};
+  SysExBin_put_u32(&header[3], code_download.len);
+  SysExBin_put_u32(&header[7], code_download.crc);
+  Yoctocore_send_binary(SYSEXBIN_CODE_HEADER, header, sizeof(header));
+}
+
+// Yoctocore_tx_room is true when a binary reply with len payload bytes can
+// be sent without dropping it.
+bool Yoctocore_tx_room(uint16_t len) {
+#if CFG_TUD_VENDOR
+  if (yoctocore_transport == YOCTOCORE_TRANSPORT_VENDOR) {
+    return UsbVendor_room(len);
+  }
+#endif
+#ifdef INCLUDE_MIDI
+  return midi_tx_free() >= SYSEXBIN_HEADER + SYSEXBIN_PACKED_SIZE(len) + 2;
+#else
+  return true;
+#endif
+}
+
+// Yoctocore_download_task streams the script being downloaded a chunk at a
+// time while the tx queue has room, starting the next script of a batch
+// when one finishes.
+void Yoctocore_download_task(Yoctocore *self) {
+  CodeDownload *dl = &code_download;
+  if (!dl->active && dl->batch_next < 0) {
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  if (!tud_ready()) {
+    CodeDownload_stop(dl);
+    dl->batch_next = -1;
+    return;
+  }
+#endif
+  if (!dl->active) {
+    if (!Yoctocore_tx_room(11)) {
+      return;
+    }
+    uint8_t index = dl->batch_next;
+    dl->batch_next = index + 1 < 64 ? index + 1 : -1;
+    Yoctocore_send_code_header(
+        CodeDownload_start(dl, index / 8, index % 8, true));
+    if (dl->active && dl->len == 0) {
+      CodeDownload_stop(dl);
+    }
+    return;
+  }
+
+  uint8_t *raw = yoctocore_bin_raw;
+  while (dl->active && Yoctocore_tx_room(4 + SYSEXBIN_CODE_CHUNK)) {
+    if (dl->binary) {
+      raw[0] = dl->scene;
+      raw[1] = dl->output;
+      raw[2] = dl->seq & 0xFF;
+      raw[3] = dl->seq >> 8;
+      uint16_t len = CodeDownload_read(dl, &raw[4], SYSEXBIN_CODE_CHUNK);
+      Yoctocore_send_binary(SYSEXBIN_CODE_PART, raw, 4 + len);
+    } else {
+      // LS always opens and LE always closes, an empty LE if needed
+      bool first = dl->seq == 0;
+      uint16_t len = CodeDownload_read(dl, &raw[4], CODE_CHUNK_SIZE - 4);
+      raw[0] = 'L';
+      raw[1] = first ? 'S' : (dl->active ? 'N' : 'E');
+      raw[2] = '0' + dl->scene;
+      raw[3] = '0' + dl->output;
+#ifdef INCLUDE_MIDI
+      send_buffer_as_sysex((char *)raw, 4 + len);
+      if (first && !dl->active) {
+        raw[1] = 'E';
+        send_buffer_as_sysex((char *)raw, 4);
+      }
+#endif
+    }
+  }
+}
+
+// Yoctocore_dump_task sends the next frame of a bulk dump once the tx queue
+// has room for it, so a full dump never overflows the queue.
+void Yoctocore_dump_task(Yoctocore *self) {
+  if (self->dump_next < 0) {
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  if (!tud_ready()) {
+    self->dump_next = -1;
+    return;
+  }
+#endif
+  if (!Yoctocore_tx_room(SYSEXBIN_SCENE_SIZE)) {
+    return;
+  }
+  uint8_t *raw = yoctocore_bin_raw;
+  uint16_t len = 0;
+  if (self->dump_next < 8) {
+    uint8_t scene = self->dump_next;
+    raw[len++] = scene;
+    raw[len++] = SYSEXBIN_SCENE_PARAMS;
+    for (uint8_t output = 0; output < 8; output++) {
+      for (uint8_t param = 0; param < SYSEXBIN_SCENE_PARAMS; param++) {
+        SysExBin_put_fixed(&raw[len],
+                           Yoctocore_get(self, scene, output, param));
+        len += 4;
+      }
+    }
+    Yoctocore_send_binary(SYSEXBIN_SCENE, raw, SysExBin_seal(raw, len));
+  } else {
+    for (uint8_t output = 0; output < 8; output++) {
+      SysExBin_put_float(&raw[len],
+                         self->out[output].voltage_calibration_slope);
+      SysExBin_put_float(&raw[len + 4],
+                         self->out[output].voltage_calibration_intercept);
+      len += 8;
+    }
+    Yoctocore_send_binary(SYSEXBIN_CALIBRATION, raw,
+                            SysExBin_seal(raw, len));
+  }
+  if (self->dump_next >= self->dump_last) {
+    self->dump_next = -1;
+  } else {
+    self->dump_next++;
+  }
+}
+
+// Yoctocore_subscription_task pushes a STATE frame with whatever changed
+// since the last one, once per subscription period.
+void Yoctocore_subscription_task(Yoctocore *self, uint32_t now) {
+  Subscription *sub = &subscription;
+  if (!Subscription_due(sub, now)) {
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  if (!tud_ready()) {
+    sub->flags = 0;
+    return;
+  }
+#endif
+  uint8_t transport = yoctocore_transport;
+  yoctocore_transport = sub->transport;
+  if (!Yoctocore_tx_room(SYSEXBIN_MAX_ENTRIES * SYSEXBIN_ENTRY_SIZE)) {
+    // try again next period, changes keep coalescing meanwhile
+    sub->last_ms = now;
+    yoctocore_transport = transport;
+    return;
+  }
+  Subscription_begin(sub, yoctocore_bin_raw);
+  if (sub->flags & SUBSCRIPTION_GLOBAL) {
+    Subscription_add(sub, &sub->scene, self->i, 0, PARAM_SCENE, self->i, 0);
+    Subscription_add(sub, &sub->tempo, self->i, 0, SYSEXBIN_STATE_TEMPO,
+                     self->global_tempo, 0);
+  }
+  if ((sub->flags & SUBSCRIPTION_PARAMS) && sub->params_scene != self->i) {
+    // a new scene is sent in full, the host may not have it yet
+    Subscription_invalidate_params(sub);
+    sub->params_scene = self->i;
+  }
+  for (uint8_t output = 0; output < 8; output++) {
+    if (!(sub->outputs & (1 << output))) {
+      continue;
+    }
+    if (sub->flags & SUBSCRIPTION_VOLTAGES) {
+      Subscription_add(sub, &sub->voltage[output], self->i, output,
+                       SYSEXBIN_STATE_VOLTAGE,
+                       self->out[output].voltage_current,
+                       SUBSCRIPTION_VOLTAGE_DEADBAND);
+    }
+    if (sub->flags & SUBSCRIPTION_PARAMS) {
+      for (uint8_t param = 0; param < SYSEXBIN_SCENE_PARAMS; param++) {
+        Subscription_add(sub, &sub->params[output][param], self->i, output,
+                         param, Yoctocore_get(self, self->i, output, param),
+                         0);
+      }
+    }
+  }
+  int32_t len = Subscription_end(sub, now);
+  if (len >= 0) {
+    Yoctocore_send_binary(SYSEXBIN_STATE, yoctocore_bin_raw, len);
+  }
+  yoctocore_transport = transport;
+}
+
+// Yoctocore_scope_task sends recorded scope samples as long as the tx queue
+// has room for a batch.
+void Yoctocore_scope_task(Yoctocore *self) {
+  if (scope.mode == SCOPE_OFF || Scope_available(&scope) == 0) {
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  if (!tud_ready()) {
+    scope.mode = SCOPE_OFF;
+    return;
+  }
+#endif
+  uint8_t transport = yoctocore_transport;
+  yoctocore_transport = scope.transport;
+  while (Scope_available(&scope) > 0 &&
+         Yoctocore_tx_room(SCOPE_BATCH_MAX_SIZE)) {
+    uint16_t len = Scope_encode(&scope, yoctocore_bin_raw);
+    Yoctocore_send_binary(SYSEXBIN_SCOPE_DATA, yoctocore_bin_raw, len);
+  }
+  yoctocore_transport = transport;
+}
+
+void Yoctocore_send_cv_status() {
+  uint8_t status[14] = {CvStream_fill(&cvstream), cvstream.playing};
+  SysExBin_put_u32(&status[2], cvstream.underruns);
+  SysExBin_put_u32(&status[6], cvstream.late);
+  SysExBin_put_u32(&status[10], cvstream.overflows);
+  Yoctocore_send_binary(SYSEXBIN_CV_STATUS, status, sizeof(status));
+}
+
+// Yoctocore_cv_stream_start hands the outputs in channels to the stream,
+// outputs that leave it go back to their mode.
+void Yoctocore_cv_stream_start(Yoctocore *self, uint8_t channels,
+                               uint32_t period_us, uint8_t depth) {
+  for (uint8_t output = 0; output < 8; output++) {
+    if ((cvstream.channels & (1 << output)) && !(channels & (1 << output))) {
+      self->out[output].voltage_do_override = false;
+    }
+  }
+  CvStream_start(&cvstream, channels, period_us, depth);
+  cvstream.transport = yoctocore_transport;
+  cvstream_batches = 0;
+}
+
+// Yoctocore_cv_stream_play runs from the control tick and puts the streamed
+// voltages in volts and in the output overrides.
+void Yoctocore_cv_stream_play(Yoctocore *self, uint64_t now_us, float *volts) {
+  if (cvstream.channels == 0) {
+    return;
+  }
+  CvStream_play(&cvstream, now_us, volts);
+  if (!cvstream.applied) {
+    return;
+  }
+  for (uint8_t output = 0; output < 8; output++) {
+    if (cvstream.channels & (1 << output)) {
+      self->out[output].voltage_override = volts[output];
+      self->out[output].voltage_do_override = true;
+      self->out[output].voltage_current = volts[output];
+    }
+  }
+}
+
+// Yoctocore_console_task sends printed script lines to the editor while
+// the tx queue has room, and to the serial console if it can take them
+// without blocking.
+void Yoctocore_console_task(Yoctocore *self) {
+  LuaConsoleLine *line;
+  while ((line = LuaConsole_peek(&luaconsole)) != NULL) {
+#ifdef INCLUDE_MIDI
+    if (!tud_ready()) {
+      return;
+    }
+#endif
+    if (!Yoctocore_tx_room(7 + LUACONSOLE_LINE_SIZE)) {
       return;
     }
+    uint8_t *raw = yoctocore_bin_raw;
+    raw[0] = line->output;
+    SysExBin_put_u32(&raw[1], line->time_ms);
+    raw[5] = line->dropped & 0xFF;
+    raw[6] = line->dropped >> 8;
+    memcpy(&raw[7], line->text, line->len);
+    Yoctocore_send_binary(SYSEXBIN_CONSOLE, raw, 7 + line->len);
+#if CFG_TUD_CDC
+    if (tud_cdc_connected() && tud_cdc_write_available() >= line->len + 1) {
+      tud_cdc_write(line->text, line->len);
+      tud_cdc_write_char('\n');
+      tud_cdc_write_flush();
+    }
+#endif
+    LuaConsole_pop(&luaconsole);
+  }
+}
+
+// Yoctocore_log_task sends buffered log records while the host listens.
+// Until then they wait in the ring, so the first records after boot are
+// kept for whoever enables the log.
+void Yoctocore_log_task(Yoctocore *self) {
+  if (!binlog_streaming || BinLog_used(&binlog) == 0) {
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  if (!tud_ready()) {
+    binlog_streaming = false;
+    return;
   }
+#endif
+  uint8_t transport = yoctocore_transport;
+  yoctocore_transport = binlog_transport;
+  while (BinLog_used(&binlog) > 0 &&
+         Yoctocore_tx_room(4 + BINLOG_DATA_SIZE)) {
+    uint8_t *raw = yoctocore_bin_raw;
+    SysExBin_put_u32(raw, binlog.dropped);
+    uint16_t len = BinLog_read(&binlog, &raw[4], BINLOG_DATA_SIZE);
+    Yoctocore_send_binary(SYSEXBIN_LOG_DATA, raw, 4 + len);
+  }
+  yoctocore_transport = transport;
+}
+
+// Yoctocore_bulk_apply applies a staged restore all at once. Called from the
+// main loop before outputs are computed. Returns true if the calibration
+// changed.
+bool Yoctocore_bulk_apply(Yoctocore *self) {
+  if (self->bulk_scene >= 0) {
+    for (uint8_t output = 0; output < 8; output++) {
+      for (uint8_t param = 0; param < SYSEXBIN_SCENE_PARAMS; param++) {
+        Yoctocore_set(self, self->bulk_scene, output, param,
+                      self->bulk_values[output][param]);
+      }
+    }
+    self->bulk_scene = -1;
+  }
+  if (self->bulk_calibration) {
+    self->bulk_calibration = false;
+    for (uint8_t output = 0; output < 8; output++) {
+      self->out[output].voltage_calibration_slope = self->bulk_slope[output];
+      self->out[output].voltage_calibration_intercept =
+          self->bulk_intercept[output];
+      self->out[output].calibration_table = false;
+    }
+    Yoctocore_save_calibrations(self);
+    return true;
+  }
+  return false;
+}
+
+// Yoctocore_process_binary handles a binary command (see sysexbin.h) from
+// either transport. SET applies every entry, GET answers with one VALUES
+// frame, DUMP starts a bulk dump and SCENE / CALIBRATION stage a bulk
+// restore.
+void Yoctocore_process_binary(Yoctocore *self, uint8_t command, uint8_t *raw,
+                             int32_t raw_len) {
+  uint8_t scene;
+  uint8_t output;
+  uint8_t param;
+  float val;
+  if (command == SYSEXBIN_SET) {
+    for (int32_t i = 0; i + SYSEXBIN_ENTRY_SIZE <= raw_len;
+         i += SYSEXBIN_ENTRY_SIZE) {
+      SysExBin_get_entry(&raw[i], &scene, &output, &param, &val);
+      if (scene >= 8 || param == PARAM_CODE) {
+        continue;
+      }
+      Yoctocore_set(self, scene, output, param, val);
+    }
+  } else if (command == SYSEXBIN_GET) {
+    // entries are read in place and replaced by the (larger) reply, so
+    // collect the requests first
+    uint8_t request[SYSEXBIN_GET_ENTRY_SIZE * SYSEXBIN_MAX_ENTRIES];
+    if (raw_len > sizeof(request)) {
+      raw_len = sizeof(request);
+    }
+    memcpy(request, raw, raw_len);
+    raw = yoctocore_bin_raw;
+    uint16_t reply_len = 0;
+    for (int32_t i = 0; i + SYSEXBIN_GET_ENTRY_SIZE <= raw_len;
+         i += SYSEXBIN_GET_ENTRY_SIZE) {
+      scene = request[i] >> 3;
+      output = request[i] & 0x07;
+      param = request[i + 1];
+      if (scene >= 8 || param == PARAM_CODE) {
+        continue;
+      }
+      val = Yoctocore_get(self, scene, output, param);
+      reply_len +=
+          SysExBin_put_entry(&raw[reply_len], scene, output, param, val);
+    }
+    self->yoctocore_getting = to_ms_since_boot(get_absolute_time());
+    Yoctocore_send_binary(SYSEXBIN_VALUES, raw, reply_len);
+  } else if (command == SYSEXBIN_DUMP && raw_len >= 1) {
+    if (raw[0] == SYSEXBIN_ALL_SCENES) {
+      self->dump_next = 0;
+      self->dump_last = 8;
+    } else if (raw[0] < 8) {
+      self->dump_next = raw[0];
+      self->dump_last = raw[0];
+    }
+    self->yoctocore_getting = to_ms_since_boot(get_absolute_time());
+  } else if (command == SYSEXBIN_SCENE) {
+    scene = raw_len > 0 ? raw[0] : 0;
+    if (raw_len != SYSEXBIN_SCENE_SIZE || scene >= 8 ||
+        raw[1] != SYSEXBIN_SCENE_PARAMS) {
+      Yoctocore_send_ack(command, scene, SYSEXBIN_ACK_BAD_SIZE);
+      return;
+    }
+    if (!SysExBin_check(raw, raw_len)) {
+      Yoctocore_send_ack(command, scene, SYSEXBIN_ACK_BAD_CRC);
+      return;
+    }
+    if (self->bulk_scene >= 0) {
+      // a second scene arrived before the loop came around
+      Yoctocore_bulk_apply(self);
+    }
+    uint16_t i = 2;
+    for (output = 0; output < 8; output++) {
+      for (param = 0; param < SYSEXBIN_SCENE_PARAMS; param++) {
+        self->bulk_values[output][param] = SysExBin_get_fixed(&raw[i]);
+        i += 4;
+      }
+    }
+    self->bulk_scene = scene;
+    Yoctocore_send_ack(command, scene, SYSEXBIN_ACK_OK);
+  } else if (command == SYSEXBIN_CALIBRATION) {
+    if (raw_len != SYSEXBIN_CALIBRATION_SIZE) {
+      Yoctocore_send_ack(command, 0, SYSEXBIN_ACK_BAD_SIZE);
+      return;
+    }
+    if (!SysExBin_check(raw, raw_len)) {
+      Yoctocore_send_ack(command, 0, SYSEXBIN_ACK_BAD_CRC);
+      return;
+    }
+    for (output = 0; output < 8; output++) {
+      self->bulk_slope[output] = SysExBin_get_float(&raw[output * 8]);
+      self->bulk_intercept[output] = SysExBin_get_float(&raw[output * 8 + 4]);
+    }
+    self->bulk_calibration = true;
+    Yoctocore_send_ack(command, 0, SYSEXBIN_ACK_OK);
+  } else if (command == SYSEXBIN_CODE_GET && raw_len >= 1) {
+    if (raw[0] == SYSEXBIN_ALL_SCENES) {
+      CodeDownload_stop(&code_download);
+      code_download.batch_next = 0;
+    } else if (raw_len >= 2 && raw[0] < 8 && raw[1] < 8) {
+      code_download.batch_next = -1;
+      uint8_t status = CodeDownload_start(&code_download, raw[0], raw[1], true);
+      Yoctocore_send_code_header(status);
+      if (code_download.active && code_download.len == 0) {
+        CodeDownload_stop(&code_download);
+      }
+    }
+  } else if (command == SYSEXBIN_CODE_BEGIN && raw_len == 10) {
+    scene = raw[0];
+    output = raw[1];
+    if (scene >= 8 || output >= 8) {
+      Yoctocore_send_code_ack(CODEUPLOAD_BAD_SIZE);
+      return;
+    }
+    if (!CodeUpload_begin(&code_upload, scene, output,
+                          SysExBin_get_u32(&raw[2]),
+                          SysExBin_get_u32(&raw[6]))) {
+      Yoctocore_send_code_ack(CODEUPLOAD_FILE_ERROR);
+      return;
+    }
+    Yoctocore_send_code_ack(CODEUPLOAD_OK);
+  } else if (command == SYSEXBIN_CODE_DATA && raw_len >= 2) {
+    uint16_t seq = raw[0] | (raw[1] << 8);
+    uint8_t status = CodeUpload_write(&code_upload, seq, &raw[2], raw_len - 2);
+    // in-order chunks are acked every few and at the last one, anything
+    // else right away
+    if (status != CODEUPLOAD_OK ||
+        code_upload.next_seq % CODEUPLOAD_ACK_EVERY == 0 ||
+        code_upload.len == code_upload.expected_len) {
+      Yoctocore_send_code_ack(status);
+    }
+  } else if (command == SYSEXBIN_CODE_END) {
+    output = code_upload.output;
+    uint8_t status = CodeUpload_finish(&code_upload);
+    if (status == CODEUPLOAD_OK) {
+      self->out[output].code_updated = true;
+      printf("[%d%d] code %" PRIu32 " bytes\n", code_upload.scene, output,
+             code_upload.len);
+    }
+    Yoctocore_send_code_ack(status);
+  } else if (command == SYSEXBIN_SUBSCRIBE && raw_len >= 4) {
+    Subscription_set(&subscription, raw[0], raw[1], raw[2] | (raw[3] << 8),
+                     yoctocore_transport,
+                     to_ms_since_boot(get_absolute_time()));
+  } else if (command == SYSEXBIN_SCOPE && raw_len >= 8) {
+    Scope_configure(&scope, raw[0], raw[1], raw[2], raw[3],
+                    (int16_t)(raw[4] | (raw[5] << 8)), raw[6] | (raw[7] << 8));
+    scope.transport = yoctocore_transport;
+  } else if (command == SYSEXBIN_CV_STREAM && raw_len >= 6) {
+    Yoctocore_cv_stream_start(self, raw[0], SysExBin_get_u32(&raw[1]), raw[5]);
+    Yoctocore_send_cv_status();
+  } else if (command == SYSEXBIN_CV_FRAMES && raw_len >= 5) {
+    uint32_t ts = SysExBin_get_u32(raw);
+    uint8_t count = raw[4];
+    bool dropped = false;
+    int16_t mv[8];
+    for (uint8_t n = 0;
+         n < count && 5 + (n + 1) * CVSTREAM_FRAME_SIZE <= raw_len; n++) {
+      uint8_t *frame = &raw[5 + n * CVSTREAM_FRAME_SIZE];
+      for (uint8_t i = 0; i < 8; i++) {
+        mv[i] = (int16_t)(frame[i * 2] | (frame[i * 2 + 1] << 8));
+      }
+      if (!CvStream_push(&cvstream, ts + n, mv)) {
+        dropped = true;
+      }
+    }
+    if (dropped || ++cvstream_batches >= CVSTREAM_STATUS_EVERY) {
+      cvstream_batches = 0;
+      Yoctocore_send_cv_status();
+    }
+  } else if (command == SYSEXBIN_LOG && raw_len >= 1) {
+    binlog_streaming = raw[0] != 0;
+    binlog_transport = yoctocore_transport;
+  } else {
+    printf("sysexbin unknown command: %d\n", command);
+  }
+}
+
+// Yoctocore_process_sysexbin unpacks a binary SysEx frame.
+void Yoctocore_process_sysexbin(Yoctocore *self, uint8_t *buffer,
+                                uint16_t length) {
+  uint8_t command;
+  if (length - SYSEXBIN_HEADER > SYSEXBIN_PACKED_SIZE(SYSEXBIN_SCENE_SIZE)) {
+    printf("sysexbin too long: %d\n", length);
+    return;
+  }
+  int32_t raw_len =
+      SysExBin_decode(buffer, length, &command, yoctocore_bin_raw);
+  if (raw_len < 0) {
+    printf("sysexbin bad frame\n");
+    return;
+  }
+  yoctocore_transport = YOCTOCORE_TRANSPORT_SYSEX;
+  Yoctocore_process_binary(self, command, yoctocore_bin_raw, raw_len);
+}
+
+// Yoctocore_process_vendor handles a frame from the vendor interface.
+void Yoctocore_process_vendor(Yoctocore *self, uint8_t command,
+                              uint8_t *payload, uint16_t len) {
+  yoctocore_transport = YOCTOCORE_TRANSPORT_VENDOR;
+  Yoctocore_process_binary(self, command, payload, len);
 }
 
 #endif  // LIB_YOCTOCORE_H
\ No newline at end of file
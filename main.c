@@ -61,13 +61,19 @@ static const uint32_t PIN_DCDC_PSM_CTRL = 23;
 //
 #include "lib/WS2812.h"
 #include "lib/adsr.h"
+#include "lib/binlog.h"
+#include "lib/buttons.h"
 #include "lib/dac.h"
+#include "lib/fastdac.h"
 #include "lib/filterexp.h"
 #include "lib/knob_change.h"
 #include "lib/libmidi.h"
 #include "lib/luavm.h"
 #include "lib/mcp3208.h"
 #include "lib/memusage.h"
+#include "lib/midiclock.h"
+#include "lib/midiclockout.h"
+#include "lib/mscdisk.h"
 #include "lib/pcg_basic.h"
 #include "lib/random.h"
 #include "lib/scales.h"
@@ -85,14 +91,19 @@ WS2812 ws2812;
 SimpleTimer pool_timer[16];
 KnobChange pool_knobs[8];
 MCP3208 mcp3208;
+MidiClock midiclock;
+MidiClockOut clockout;
 bool blink_on = false;
 const uint8_t button_num = 9;
 const uint8_t button_pins[9] = {1, 8, 20, 21, 22, 26, 27, 28, 29};
 uint8_t button_values[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+Buttons buttons;
 uint32_t time_per_iteration = 0;
 uint32_t timer_per[32];
 uint32_t lfo_ct_last[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 float lfo_index_acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+// last lfo step of outputs run by the fast DAC rate
+uint64_t lfo_us_last[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 
 #if CFG_TUD_CDC
 char cdc_rx_buffer[CFG_TUD_CDC_RX_BUFSIZE];
@@ -111,12 +122,32 @@ const float division_values[19] = {
     2.0f,          3.0f,          4.0f,          6.0f,         8.0f,
     12.0f,         16.0f,         24.0f,         48.0f};
 
+// set_global_tempo changes the tempo the master clock and all outputs set to
+// "global" run at
+void set_global_tempo(float bpm) {
+  yocto.global_tempo = bpm;
+  MidiClockOut_set_bpm(&clockout, bpm);
+  Yoctocore_schedule_save(&yocto);
+}
+
+// apply_calibration gives the DAC the calibration of an output, its table
+// when it has one
+void apply_calibration(uint8_t i) {
+  if (!yocto.out[i].calibration_table ||
+      !DAC_set_calibration_points(&dac, i, yocto.out[i].calibration_points)) {
+    DAC_set_calibration(&dac, i, yocto.out[i].voltage_calibration_slope,
+                        yocto.out[i].voltage_calibration_intercept);
+  }
+}
+
 #ifdef INCLUDE_MIDI
 #include "lib/midi_comm.h"
 #include "lib/midicallback.h"
 #endif
 
-void update_linked_outs(bool triggering_outs[], bool trigger, uint32_t ct) {
+// update_linked_outs gates the outputs linked to triggering_outs at time_ms,
+// in the same fractional milliseconds the fast DAC alarm steps them with
+void update_linked_outs(bool triggering_outs[], bool trigger, double time_ms) {
   for (uint8_t i2 = 0; i2 < 8; i2++) {
     Config *config = &yocto.config[yocto.i][i2];
     Out *out = &yocto.out[i2];
@@ -127,10 +158,13 @@ void update_linked_outs(bool triggering_outs[], bool trigger, uint32_t ct) {
     if (config->mode == MODE_ENVELOPE) {
       // trigger the envelope
       // printf("[out%d] env_off linked to out%d\n", i2 + 1, config->linked_to);
-      ADSR_gate(&out->adsr, trigger, ct);
+      // the fast DAC alarm may be in the middle of this envelope
+      uint32_t status = save_and_disable_interrupts();
+      ADSR_gate(&out->adsr, trigger, time_ms);
+      restore_interrupts(status);
     } else if (config->mode == MODE_GATE) {
       // trigger the gate
-      printf("[out%d] gate_off linked to out%d\n", i2 + 1, config->linked_to);
+      BINLOG(MIDI, BINLOG_DEBUG, GATE_LINKED, i2 + 1, config->linked_to);
       if (trigger) {
         out->voltage_set = config->max_voltage;
       } else {
@@ -142,7 +176,6 @@ void update_linked_outs(bool triggering_outs[], bool trigger, uint32_t ct) {
 
 void on_successful_lua_callback(int i, float volts, bool volts_new,
                                 bool trigger) {
-  uint32_t ct = to_ms_since_boot(get_absolute_time());
   Out *out = &yocto.out[i];
   bool triggering_outs[8] = {false};
 
@@ -152,22 +185,23 @@ void on_successful_lua_callback(int i, float volts, bool volts_new,
 
   // find any linked outputs and activate the envelope
   triggering_outs[i] = true;
-  update_linked_outs(triggering_outs, trigger, ct);
+  update_linked_outs(triggering_outs, trigger, time_us_64() / 1000.0);
 }
 
 void timer_callback_sample_knob(bool on, int user_data) {
   for (uint8_t i = 0; i < 8; i++) {
-    int16_t val_changed =
-        KnobChange_update(&pool_knobs[i], MCP3208_read(&mcp3208, i, false));
+    float val_changed = KnobChange_update(
+        &pool_knobs[i],
+        MCP3208_read(&mcp3208, i) * (KNOB_CHANGE_MAX / MCP3208_MAX));
     if (val_changed != -1) {
-      printf("Knob %d: %d\n", i, val_changed);
+      BINLOG(KNOB, BINLOG_INFO, KNOB, i, BINLOG_F(val_changed));
       Config *config = &yocto.config[yocto.i][i];
       if (config->mode == MODE_CODE) {
         float volts;
         bool volts_new;
         bool trigger;
-        float val = val_changed / 1023.0f;
-        printf("Lua on_knob #%d - val=%f\n", i, val);
+        float val = val_changed / KNOB_CHANGE_MAX;
+        BINLOG(LUA, BINLOG_DEBUG, LUA_ON_KNOB, i, BINLOG_F(val));
         if (luaRunOnKnob(i, val, &volts, &volts_new, &trigger)) {
           on_successful_lua_callback(i, volts, volts_new, trigger);
         }
@@ -176,10 +210,6 @@ void timer_callback_sample_knob(bool on, int user_data) {
   }
 }
 
-uint8_t gammaCorrectUint8_t(float value) {
-  return roundf(255.0f * powf(value, 0.8f));
-}
-
 const uint8_t const_colors[11][3] = {
     {160, 160, 160},  // White
     {255, 0, 0},      // Red
@@ -236,36 +266,33 @@ void timer_callback_ws2812(bool on, int user_data) {
     // }
     // WS2812_show(&ws2812);
     // return;
-    if (yocto.out[i].voltage_current < 0) {
+    float voltage = yocto.out[i].voltage_current;
+    // millivolts, so the colors below are integer math
+    int32_t mv = util_clamp((int32_t)(voltage * 1000.0f), -5000, 10000);
+    if (voltage < 0) {
       // 0 to -5V goes 0 -> blue with gamma correction
-      float t = linlin(yocto.out[i].voltage_current, -5.0, 0.0, 0.0, 1.0);
-      uint8_t blue = gammaCorrectUint8_t(t);  // Apply gamma to red intensity
+      uint8_t blue = WS2812_gamma(&ws2812, (mv + 5000) * 255 / 5000);
       WS2812_fill(&ws2812, i, 0, 0, 255 - blue);
-    } else if (yocto.out[i].voltage_current == 0) {
+    } else if (voltage == 0) {
       // Voltage at 0V means off
       WS2812_fill(&ws2812, i, 0, 0, 0);
-    } else if (yocto.out[i].voltage_current <= 5.0) {
+    } else if (mv <= 5000) {
       // 0 to 5V goes 0 -> green with gamma correction
-      float t = linlin(yocto.out[i].voltage_current, 0.0, 5.0, 0.0, 1.0);
-      uint8_t green = gammaCorrectUint8_t(t);  // Apply gamma to green intensity
+      uint8_t green = WS2812_gamma(&ws2812, mv * 255 / 5000);
       WS2812_fill(&ws2812, i, 0, green, 0);
     } else {
       // 5 to 10V goes green -> red with constant perceived brightness
       uint8_t brightness = 255;  // Maximum brightness level
-      float t = linlin(yocto.out[i].voltage_current, 5.0, 10.0, 0.0, 1.0);
-
-      // Calculate raw values for red and green
-      float red_raw = t;
-      float green_raw = 1.0 - t;
+      uint8_t t = (mv - 5000) * 255 / 5000;
 
       // Apply gamma correction
-      uint8_t red = gammaCorrectUint8_t(red_raw);
-      uint8_t green = gammaCorrectUint8_t(green_raw);
+      uint32_t red = WS2812_gamma(&ws2812, t);
+      uint32_t green = WS2812_gamma(&ws2812, 255 - t);
 
       // Normalize to constant brightness
-      float total = red + green;
-      red = roundf((red / total) * brightness);
-      green = roundf((green / total) * brightness);
+      uint32_t total = red + green;
+      red = (red * brightness + total / 2) / total;
+      green = (green * brightness + total / 2) / total;
 
       WS2812_fill(&ws2812, i, red, green,
                   0);  // Set LED with gamma-corrected brightness
@@ -290,32 +317,107 @@ void timer_callback_ws2812(bool on, int user_data) {
 
 void timer_callback_check_memory_usage(bool on, int user_data) {
   uint32_t free_heap = getFreeHeap();
-  // printf_sysex("free_heap %d\n", free_heap);
-  printf("free_heap %d\n", free_heap);
+  BINLOG(SYSTEM, BINLOG_INFO, FREE_HEAP, free_heap);
+  BINLOG(SYSTEM, BINLOG_INFO, DAC_TIMING, dac.update_us, dac.update_us_max,
+         dac.mcp4728[0].errors + dac.mcp4728[1].errors);
   if (free_heap < 161216) {
     uint64_t ct = time_us_64();
     luaGarbageCollect();
-    printf("GC %d %lld\n", free_heap, time_us_64() - ct);
+    BINLOG(SYSTEM, BINLOG_INFO, GC, free_heap, (uint32_t)(time_us_64() - ct));
+  }
+}
+
+// output_dithers is true for outputs that hold pitches and have dithering
+// turned on.
+bool output_dithers(uint8_t i) {
+  Config *config = &yocto.config[yocto.i][i];
+  return (yocto.dither & (1 << i)) &&
+         (config->mode == MODE_NOTE || config->quantization > 0) &&
+         !yocto.out[i].voltage_do_override;
+}
+
+// fast_dac_owns is true for outputs whose envelope or lfo runs from the
+// fast DAC alarm instead of the 500 hz loop.
+bool fast_dac_owns(uint8_t i) {
+  if (!FastDac_has(&fastdac, i) || yocto.out[i].voltage_do_override) {
+    return false;
+  }
+  uint8_t mode = yocto.config[yocto.i][i].mode;
+  return mode == MODE_ENVELOPE || mode == MODE_LFO;
+}
+
+// fast_dac_tick runs from the FastDac alarm, it steps the envelopes and lfos
+// of the fast outputs with microsecond time and writes the DAC.
+void fast_dac_tick(uint8_t mask, uint64_t now_us) {
+  for (uint8_t i = 0; i < 8; i++) {
+    if (!(mask & (1 << i)) || !fast_dac_owns(i)) {
+      continue;
+    }
+    Out *out = &yocto.out[i];
+    Config *config = &yocto.config[yocto.i][i];
+    if (config->mode == MODE_ENVELOPE) {
+      out->voltage_set =
+          linlin(ADSR_process(&out->adsr, now_us / 1000.0), 0.0f, 1.0f,
+                 config->min_voltage, config->max_voltage);
+      out->voltage_current = out->voltage_set;
+    } else {
+      if (lfo_us_last[i] == 0) {
+        lfo_us_last[i] = now_us;
+      }
+      float step = (now_us - lfo_us_last[i]) / (config->lfo_period * 1e6f);
+      lfo_us_last[i] = now_us;
+      lfo_index_acc[i] = fmodf(lfo_index_acc[i] + step, 1.f);
+      if (out->lfo_disabled) {
+        continue;
+      }
+      out->voltage_set =
+          get_lfo_value(config->lfo_waveform, lfo_index_acc[i] * 1000,
+                        1 * 1000, config->min_voltage, config->max_voltage, 0,
+                        &out->noise, &out->slew_lfo);
+      out->voltage_current =
+          scale_quantize_voltage(config->quantization, config->root_note,
+                                 config->v_oct, out->voltage_set);
+    }
+    if (output_dithers(i)) {
+      DAC_set_voltage_dither(&dac, i, out->voltage_current);
+    } else {
+      DAC_set_voltage(&dac, i, out->voltage_current);
+    }
   }
+  DAC_update(&dac);
 }
 
 void timer_callback_update_voltage(bool on, int user_data) {
   // update the DAC
+  float volts[8];
   for (uint8_t i = 0; i < 8; i++) {
-    DAC_set_voltage(&dac, i, yocto.out[i].voltage_current);
+    volts[i] = yocto.out[i].voltage_current;
   }
-  DAC_update(&dac);
+  // streamed voltages go straight to the DAC at the tick they are due
+  Yoctocore_cv_stream_play(&yocto, time_us_64(), volts);
+  for (uint8_t i = 0; i < 8; i++) {
+    if (fast_dac_owns(i)) {
+      continue;
+    } else if (output_dithers(i)) {
+      DAC_set_voltage_dither(&dac, i, volts[i]);
+    } else {
+      DAC_set_voltage(&dac, i, volts[i]);
+    }
+  }
+  // while the fast rate runs its alarm sends everything
+  if (!FastDac_running(&fastdac)) {
+    DAC_update(&dac);
+  }
+  // the scope sees exactly what went to the DAC
+  Scope_sample(&scope, volts);
 }
 
 void timer_callback_blink(bool on, int user_data) { blink_on = on; }
 
 #ifdef INCLUDE_MIDI
 void midi_note_off(int channel, int note) {
-  uint32_t ct = to_ms_since_boot(get_absolute_time());
   channel++;  // 1-indexed
-#ifdef DEBUG_MIDI
-  printf("ch=%d note_off=%d\n", channel, note);
-#endif
+  BINLOG(MIDI, BINLOG_DEBUG, NOTE_OFF, channel, note);
   bool outs_with_note_change[8] = {false, false, false, false,
                                    false, false, false, false};
   // check if any outputs are set to midi pitch
@@ -329,12 +431,12 @@ void midi_note_off(int channel, int note) {
       out->note_on.note = 0;
       out->note_on.time_on = 0;
       outs_with_note_change[i] = true;
-      printf("[out%d] note_off %d\n", i + 1, note);
+      BINLOG(MIDI, BINLOG_DEBUG, NOTE_OFF_OUT, i + 1, note);
     } else if (config->mode == MODE_CODE) {
       float volts;
       bool volts_new;
       bool trigger;
-      printf("Lua on_note_off #%d - ch=%d, note=%d\n", i, channel, note);
+      BINLOG(LUA, BINLOG_DEBUG, LUA_ON_NOTE_OFF, i, channel, note);
       if (luaRunOnNoteOff(i, channel, note, &volts, &volts_new, &trigger)) {
         // on_successful_lua_callback(i, volts, trigger);
         out->voltage_set = volts;
@@ -343,34 +445,27 @@ void midi_note_off(int channel, int note) {
     }
   }
   // find any linked outputs and activate the envelope
-  update_linked_outs(outs_with_note_change, false, ct);
+  update_linked_outs(outs_with_note_change, false, time_us_64() / 1000.0);
 }
 
 void midi_note_on(int channel, int note, int velocity) {
   uint32_t ct = to_ms_since_boot(get_absolute_time());
   channel++;  // 1-indexed
-#ifdef DEBUG_MIDI
-  printf("ch=%d note_on=%d vel=%d\n", channel, note, velocity);
-#endif
+  BINLOG(MIDI, BINLOG_DEBUG, NOTE_ON, channel, note, velocity);
   // special commands
-  // 9F 01 01
+  // 9F 01 01, polled state for older editors (newer ones subscribe, see
+  // SYSEXBIN_SUBSCRIBE)
   if (channel == 16 && note == 1 && velocity == 1) {
     char sparkline_update[48];
-    sparkline_update[0] = '\0';
+    int n = 0;
     for (uint8_t i = 0; i < 8; i++) {
-      if (i == 0) {
-        sprintf(sparkline_update, "%d",
-                (int)roundf(linlin(yocto.out[i].voltage_current, -5.0f, 10.0f,
-                                   0.0f, 9990.0f)));
-      } else {
-        sprintf(sparkline_update, "%s_%d", sparkline_update,
-                (int)roundf(linlin(yocto.out[i].voltage_current, -5.0f, 10.0f,
-                                   0.0f, 9999.0f)));
-      }
+      n += snprintf(sparkline_update + n, sizeof(sparkline_update) - n, "%d_",
+                    (int)roundf(linlin(yocto.out[i].voltage_current, -5.0f,
+                                       10.0f, 0.0f, 9999.0f)));
     }
     // add the current bpm
-    sprintf(sparkline_update, "%s_%d", sparkline_update,
-            (int)yocto.global_tempo);
+    snprintf(sparkline_update + n, sizeof(sparkline_update) - n, "%d",
+             (int)yocto.global_tempo);
     printf_sysex("%s\n", sparkline_update);
     return;
   }
@@ -400,18 +495,16 @@ void midi_note_on(int channel, int note, int velocity) {
             (float)(note - config->root_note) * config->v_oct / 12.0f +
             config->min_voltage;
         outs_with_note_change[i] = true;
-#ifdef DEBUG_MIDI
-        printf("[out%d] %d %d %f %f to %f\n", i + 1, note, config->root_note,
-               config->v_oct, config->min_voltage, out->voltage_set);
-#endif
+        BINLOG(MIDI, BINLOG_DEBUG, NOTE_ON_OUT, i + 1, note, config->root_note,
+               BINLOG_F(config->v_oct), BINLOG_F(config->min_voltage),
+               BINLOG_F(out->voltage_set));
         break;  // TODO make this an option
       }
     } else if (config->mode == MODE_CODE) {
       float volts;
       bool volts_new;
       bool trigger;
-      printf("Lua on_note_on #%d - ch=%d, note=%d, vel=%d\n", i, channel, note,
-             velocity);
+      BINLOG(LUA, BINLOG_DEBUG, LUA_ON_NOTE_ON, i, channel, note, velocity);
       if (luaRunOnNoteOn(i, channel, note, velocity, &volts, &volts_new,
                          &trigger)) {
         // on_successful_lua_callback(i, volts, trigger);
@@ -421,12 +514,12 @@ void midi_note_on(int channel, int note, int velocity) {
     }
   }
   // find any linked outputs and activate the envelope
-  update_linked_outs(outs_with_note_change, true, ct);
+  update_linked_outs(outs_with_note_change, true, time_us_64() / 1000.0);
 }
 
 void midi_cc(int channel, int cc, int value) {
   channel++;  // 1-indexed
-  printf("ch=%d cc=%d val=%d (%d)\n", channel, cc, value, button_values[0]);
+  BINLOG(MIDI, BINLOG_INFO, CC, channel, cc, value);
   for (uint8_t i = 0; i < 8; i++) {
     Config *config = &yocto.config[yocto.i][i];
     Out *out = &yocto.out[i];
@@ -435,7 +528,8 @@ void midi_cc(int channel, int cc, int value) {
         // set the voltage
         out->voltage_set =
             linlin(value, 0, 127, config->min_voltage, config->max_voltage);
-        printf("[cc%d] %f\n", i + 1, out->voltage_current);
+        BINLOG(MIDI, BINLOG_DEBUG, CC_OUT, i + 1,
+               BINLOG_F(out->voltage_current));
       } else if (button_values[i]) {
         // listen and learn the channel and cc
         yocto.config[yocto.i][i].midi_channel = channel;
@@ -447,7 +541,7 @@ void midi_cc(int channel, int cc, int value) {
       float volts;
       bool volts_new;
       bool trigger;
-      printf("Lua on_cc #%d - cc=%d, cal=%d\n", i, cc, value);
+      BINLOG(LUA, BINLOG_DEBUG, LUA_ON_CC, i, cc, value);
       if (luaRunOnCc(i, cc, value, &volts, &volts_new, &trigger)) {
         on_successful_lua_callback(i, volts, volts_new, trigger);
       }
@@ -457,7 +551,7 @@ void midi_cc(int channel, int cc, int value) {
 
 void midi_key_pressure(int channel, int note, int pressure) {
   channel++;  // 1-indexed
-  printf("ch=%d note=%d pressure=%d\n", channel, note, pressure);
+  BINLOG(MIDI, BINLOG_INFO, KEY_PRESSURE, channel, note, pressure);
   for (uint8_t i = 0; i < 8; i++) {
     Config *config = &yocto.config[yocto.i][i];
     Out *out = &yocto.out[i];
@@ -466,7 +560,8 @@ void midi_key_pressure(int channel, int note, int pressure) {
         // set the voltage
         out->voltage_set =
             linlin(pressure, 0, 127, config->min_voltage, config->max_voltage);
-        printf("[kp%d] %f\n", i + 1, out->voltage_current);
+        BINLOG(MIDI, BINLOG_DEBUG, KEY_PRESSURE_OUT, i + 1,
+               BINLOG_F(out->voltage_current));
       } else if (button_values[i]) {
         // listen and learn the channel
         yocto.config[yocto.i][i].midi_channel = channel;
@@ -479,7 +574,7 @@ void midi_key_pressure(int channel, int note, int pressure) {
 
 void midi_program_change(int channel, int program) {
   channel++;  // 1-indexed
-  printf("ch=%d program=%d\n", channel, program);
+  BINLOG(MIDI, BINLOG_INFO, PROGRAM_CHANGE, channel, program);
   for (uint8_t i = 0; i < 8; i++) {
     Config *config = &yocto.config[yocto.i][i];
     Out *out = &yocto.out[i];
@@ -488,7 +583,8 @@ void midi_program_change(int channel, int program) {
         // set the voltage
         out->voltage_set =
             linlin(program, 0, 127, config->min_voltage, config->max_voltage);
-        printf("[pc%d] %f\n", i + 1, out->voltage_current);
+        BINLOG(MIDI, BINLOG_DEBUG, PROGRAM_CHANGE_OUT, i + 1,
+               BINLOG_F(out->voltage_current));
       } else if (button_values[i]) {
         // listen and learn the channel
         yocto.config[yocto.i][i].midi_channel = channel;
@@ -501,7 +597,7 @@ void midi_program_change(int channel, int program) {
 
 void midi_channel_pressure(int channel, int pressure) {
   channel++;  // 1-indexed
-  printf("ch=%d pressure=%d\n", channel, pressure);
+  BINLOG(MIDI, BINLOG_INFO, CHANNEL_PRESSURE, channel, pressure);
   for (uint8_t i = 0; i < 8; i++) {
     Config *config = &yocto.config[yocto.i][i];
     Out *out = &yocto.out[i];
@@ -510,7 +606,8 @@ void midi_channel_pressure(int channel, int pressure) {
         // set the voltage
         out->voltage_set =
             linlin(pressure, 0, 127, config->min_voltage, config->max_voltage);
-        printf("[cp%d] %f\n", i + 1, out->voltage_current);
+        BINLOG(MIDI, BINLOG_DEBUG, CHANNEL_PRESSURE_OUT, i + 1,
+               BINLOG_F(out->voltage_current));
       } else if (button_values[i]) {
         // listen and learn the channel
         yocto.config[yocto.i][i].midi_channel = channel;
@@ -523,7 +620,7 @@ void midi_channel_pressure(int channel, int pressure) {
 
 void midi_pitch_bend(int channel, int value) {
   channel++;  // 1-indexed
-  printf("ch=%d pitch_bend=%d\n", channel, value);
+  BINLOG(MIDI, BINLOG_INFO, PITCH_BEND, channel, value);
   // value is 14-bit number
   for (uint8_t i = 0; i < 8; i++) {
     Config *config = &yocto.config[yocto.i][i];
@@ -533,7 +630,8 @@ void midi_pitch_bend(int channel, int value) {
         // set the voltage
         out->voltage_set =
             linlin(value, 0, 16383, config->min_voltage, config->max_voltage);
-        printf("[pb%d] %f\n", i + 1, out->voltage_current);
+        BINLOG(MIDI, BINLOG_DEBUG, PITCH_BEND_OUT, i + 1,
+               BINLOG_F(out->voltage_current));
       } else if (button_values[i]) {
         // listen and learn the channel
         yocto.config[yocto.i][i].midi_channel = channel;
@@ -544,50 +642,156 @@ void midi_pitch_bend(int channel, int value) {
   }
 }
 
-#define MIDI_DELTA_COUNT_MAX 24
-uint32_t midi_timing_count = 0;
-uint64_t midi_last_time = 0;
-int64_t midi_timing_differences[MIDI_DELTA_COUNT_MAX] = {0};
-void midi_timing() {
-  if (midi_last_time == 0) {
-    midi_last_time = time_us_64();
+// midi_clock_sync_outputs locks every output that follows the global tempo
+// to the filtered position of the incoming clock
+void midi_clock_sync_outputs(uint64_t now_us) {
+  if (!midiclock.running || midiclock.period_us <= 0) {
     return;
   }
+  float ct = (float)(now_us / 1000);
+  for (uint8_t i = 0; i < 8; i++) {
+    Config *config = &yocto.config[yocto.i][i];
+    if ((config->mode != MODE_CLOCK && config->mode != MODE_CODE) ||
+        config->clock_tempo > 0) {
+      continue;
+    }
+    float division = division_values[config->clock_division];
+    SimpleTimer_sync(&pool_timer[i], yocto.global_tempo, division,
+                     MidiClock_phase(&midiclock, now_us, division), ct);
+  }
+}
 
-  midi_timing_count++;
-  uint64_t now_time = time_us_64();
-  int index = midi_timing_count % MIDI_DELTA_COUNT_MAX;
-
-  // Store the time difference between consecutive MIDI Clock messages
-  midi_timing_differences[index] = now_time - midi_last_time;
-
-  // Update the last time to the current time
-  midi_last_time = now_time;
+void midi_clock_tick(uint64_t now_us) {
+  bool was_locked = midiclock.locked;
+  MidiClock_tick(&midiclock, now_us);
+  if (midiclock.locked != was_locked) {
+    BINLOG(MIDI, BINLOG_INFO, MIDICLOCK_LOCK, midiclock.locked,
+           BINLOG_F(MidiClock_bpm(&midiclock)));
+  }
+  float bpm = MidiClock_bpm(&midiclock);
+  if (bpm > 0 && !clockout.enabled) {
+    // keep a hundredth of a bpm so the timers do not recompute every tick
+    yocto.global_tempo = roundf(bpm * 100.0f) / 100.0f;
+  }
+  midi_clock_sync_outputs(now_us);
+}
 
-  // Only recalculate BPM when the buffer wraps around
-  if (index == 0) {
-    float total_time_us = 0.0f;
+void midi_timing() {
+  if (clockout.enabled) {
+    // leading, ignore incoming clock
+    return;
+  }
+  midi_clock_tick(time_us_64());
+}
 
-    // Sum all the time differences in the buffer
-    for (uint8_t i = 0; i < MIDI_DELTA_COUNT_MAX; i++) {
-      total_time_us += midi_timing_differences[i];
-    }
+#if CFG_TUD_VENDOR
+void usb_vendor_command(uint8_t command, uint8_t *payload, uint16_t len) {
+  if (mscdisk.active) {
+    // the host owns the card, nothing here may touch the filesystem
+    return;
+  }
+  Yoctocore_process_vendor(&yocto, command, payload, len);
+}
+#endif
 
-    // Calculate the average time per tick
-    float average_interval_us = total_time_us / MIDI_DELTA_COUNT_MAX;
+// storage_mode_enter saves anything pending, closes open transfers and
+// unmounts FatFs before the card is handed to the host
+void storage_mode_enter() {
+  if (yocto.debounce_save > 0) {
+    yocto.debounce_save = 0;
+    Yoctcoroe_do_save(&yocto);
+  }
+  CodeUpload_abort(&code_upload);
+  CodeDownload_stop(&code_download);
+  code_download.batch_next = -1;
+  sd_unmount();
+  if (!MscDisk_enter(&mscdisk)) {
+    run_mount();
+    return;
+  }
+#ifdef INCLUDE_MIDI
+  printf_sysex("storage1");
+#endif
+}
 
-    // Calculate BPM
-    float bpm = (60000000.0f / average_interval_us) / 24.0f;
+// storage_mode_exit remounts the card and reloads everything the host may
+// have changed: savefile, calibrations and the scripts of the current scene
+void storage_mode_exit() {
+  MscDisk_exit(&mscdisk);
+  // button edges queued while the loop was parked are stale, including
+  // the combo that ends storage mode
+  uint32_t status = save_and_disable_interrupts();
+  Buttons_flush(&buttons, time_us_64());
+  restore_interrupts(status);
+  if (!run_mount()) {
+    printf("[main]: failed to remount sd card\n");
+    return;
+  }
+  Yoctocore_load(&yocto);
+  Yoctocore_get_calibrations(&yocto);
+  for (uint8_t i = 0; i < 8; i++) {
+    apply_calibration(i);
+    // forces the mode to be set up again, which reloads any script
+    yocto.out[i].mode_last = -1;
+  }
+  MidiClockOut_set_bpm(&clockout, yocto.global_tempo);
+#ifdef INCLUDE_MIDI
+  printf_sysex("storage0");
+#endif
+}
 
-    // Round to the nearest 10th
-    bpm = roundf(bpm);
+// storage_combo_task asks to toggle storage mode when shift and the first
+// and last buttons are held together
+void storage_combo_task(uint32_t ct) {
+  static uint32_t held_since = 0;
+  static bool fired = false;
+  // the main loop does not poll the buttons in storage mode
+  Buttons_poll(&buttons);
+  bool held = Buttons_pressed(&buttons, 8) && Buttons_pressed(&buttons, 0) &&
+              Buttons_pressed(&buttons, 7);
+  if (!held) {
+    held_since = 0;
+    fired = false;
+    return;
+  }
+  if (held_since == 0) {
+    held_since = ct;
+  } else if (!fired && ct - held_since > DURATION_HOLD_LONG) {
+    fired = true;
+    MscDisk_request(&mscdisk, !mscdisk.active);
+  }
+}
 
-    // Print the BPM
-    printf("bpm: %2.1f\n", bpm);
-    yocto.global_tempo = bpm;
+// midi_clock_out_task sends the master clock counted by the alarm and runs
+// the outputs off the same ticks
+void midi_clock_out_task() {
+  // taken before the enabled check, disabling queues a stop
+  uint8_t transport = MidiClockOut_take_transport(&clockout);
+  if (transport == MIDICLOCKOUT_START) {
+    send_midi_start();
+    MidiClock_start(&midiclock);
+    midi_clock_reset_outputs();
+  } else if (transport == MIDICLOCKOUT_STOP) {
+    send_midi_stop();
+    if (clockout.enabled) {
+      // a stop while leading holds the outputs, a stop from turning the
+      // master off was already released to the follower
+      MidiClock_stop(&midiclock);
+    }
+  }
+  if (!clockout.enabled) {
+    return;
+  }
+  uint64_t tick_us;
+  uint32_t ticks = MidiClockOut_take(&clockout, &tick_us);
+  uint32_t period_us = clockout.period_q8 >> 8;
+  for (uint32_t i = 0; i < ticks; i++) {
+    send_midi_clock();
+    midi_clock_tick(tick_us - (uint64_t)(ticks - 1 - i) * period_us);
   }
 }
 
+
 void midi_event_note_on(char chan, char data1, char data2) {
   midi_note_on(chan, data1, data2);
 }
@@ -624,17 +828,17 @@ void midi_event_key_pressure(char chan, char data1, char data2) {
 void midi_event_clock(char chan, char data1, char data2) { midi_timing(); }
 
 void midi_event_start(char chan, char data1, char data2) {
-  printf("midi_event_start: %d %d %d\n", chan, data1, data2);
+  BINLOG(MIDI, BINLOG_INFO, MIDI_START, chan);
   midi_start();
 }
 
 void midi_event_continue(char chan, char data1, char data2) {
-  printf("midi_event_continue: %d %d %d\n", chan, data1, data2);
+  BINLOG(MIDI, BINLOG_INFO, MIDI_CONTINUE, chan);
   midi_continue();
 }
 
 void midi_event_stop(char chan, char data1, char data2) {
-  printf("midi_event_stop: %d %d %d\n", chan, data1, data2);
+  BINLOG(MIDI, BINLOG_INFO, MIDI_STOP, chan);
   midi_stop();
 }
 #endif
@@ -670,12 +874,12 @@ int main() {
   gpio_put(PIN_DCDC_PSM_CTRL, 1);  // PWM mode for less Audio noise
 
   // setup i2c
-  i2c_init(i2c0, 50 * 1000);
+  i2c_init(i2c0, MCP4728_BAUDRATE);
   gpio_set_function(I2C0_SDA_PIN, GPIO_FUNC_I2C);
   gpio_set_function(I2C0_SCL_PIN, GPIO_FUNC_I2C);
   gpio_pull_up(I2C0_SDA_PIN);
   gpio_pull_up(I2C0_SCL_PIN);
-  i2c_init(i2c1, 50 * 1000);
+  i2c_init(i2c1, MCP4728_BAUDRATE);
   gpio_set_function(I2C1_SDA_PIN, GPIO_FUNC_I2C);
   gpio_set_function(I2C1_SCL_PIN, GPIO_FUNC_I2C);
   gpio_pull_up(I2C1_SDA_PIN);
@@ -719,19 +923,15 @@ int main() {
 
   // initialize knobs
   for (uint8_t i = 0; i < 8; i++) {
-    KnobChange_init(&pool_knobs[i], 3);
+    KnobChange_init(&pool_knobs[i], 0.25f);
   }
 
-  // setup buttons
-  for (uint8_t i = 0; i < button_num; i++) {
-    gpio_init(button_pins[i]);
-    gpio_set_dir(button_pins[i], GPIO_IN);
-    gpio_pull_up(button_pins[i]);
-  }
+  // setup buttons, their edges are queued from interrupts
+  Buttons_init(&buttons, button_pins, button_num);
 
-  // initialize MCP3208
-  MCP3208_init(&mcp3208, spi0, PIN_SPI_CSN, PIN_SPI_CLK, PIN_SPI_RX,
-               PIN_SPI_TX);
+  // initialize MCP3208, which scans the knobs from here on
+  MCP3208_init(&mcp3208, pio0, MCP3208_SM, PIN_SPI_CSN, PIN_SPI_CLK,
+               PIN_SPI_TX, PIN_SPI_RX);
 
   // initialize WS2812
   WS2812_init(&ws2812, WS2812_PIN, pio0, WS2812_SM, 16);
@@ -774,8 +974,19 @@ int main() {
   // // try loading the code for scene 0, output 0
   // Yoctocore_load_code(&yocto, 0, 0);
 
+  // initialize midi clock follower and master clock
+  MidiClock_init(&midiclock);
+  MidiClockOut_init(&clockout, yocto.global_tempo);
+  UsbVendor_init(&usbvendor);
+  MscDisk_init(&mscdisk);
+  if (yocto.clock_master) {
+    MidiClockOut_enable(&clockout, true);
+    MidiClockOut_start(&clockout);
+  }
+
   // initialize dac
   DAC_init(&dac);
+  FastDac_init(&fastdac, fast_dac_tick);
 #ifdef DEBUG_VOLTAGE_CALIBRATION
   sleep_ms(5000);
   printf("DAC calibration\n");
@@ -784,15 +995,14 @@ int main() {
       DAC_set_voltage(&dac, i, volts);
     }
     DAC_update(&dac);
+    DAC_wait(&dac);
     printf("calibration at %d\n", volts);
     sleep_ms(5000);
   }
 #endif
   Yoctocore_get_calibrations(&yocto);
   for (uint8_t i = 0; i < 8; i++) {
-    dac.voltage_calibration_slope[i] = yocto.out[i].voltage_calibration_slope;
-    dac.voltage_calibration_intercept[i] =
-        yocto.out[i].voltage_calibration_intercept;
+    apply_calibration(i);
   }
 
   for (uint8_t i = 0; i < 8; i++) {
@@ -812,7 +1022,7 @@ int main() {
     }
   }
   // setup a timer at 5 milliseconds to sample the knobs
-  SimpleTimer_init(&pool_timer[8], 1000.0f / 11.0f * 30, 1.0f, 0,
+  SimpleTimer_init(&pool_timer[8], 1000.0f / 5.0f * 30, 1.0f, 0,
                    timer_callback_sample_knob, 0, ct);
   SimpleTimer_start(&pool_timer[8]);
   // setup a timer at 33 hz to update the ws2812
@@ -855,14 +1065,36 @@ int main() {
     start_time_us = time_us_32();
     uint32_t us = time_us_32();
 #ifdef INCLUDE_MIDI
+    midi_clock_out_task();
     tud_task();
+    midi_tx_task();
+#if CFG_TUD_VENDOR
+    UsbVendor_task(&usbvendor, usb_vendor_command);
+#endif
     midi_comm_task(midi_sysex_callback, midi_note_on, midi_note_off,
                    midi_key_pressure, midi_cc, midi_program_change,
                    midi_channel_pressure, midi_pitch_bend, midi_start,
-                   midi_continue, midi_stop, midi_timing);
+                   midi_continue, midi_stop, midi_timing,
+                   midi_song_position);
 #endif
     timer_per[0] = time_us_32() - us;
 
+    // storage mode, the host owns the sd card and only usb keeps running
+    storage_combo_task(to_ms_since_boot(get_absolute_time()));
+    switch (MscDisk_take(&mscdisk)) {
+      case MSCDISK_REQUEST_ENTER:
+        storage_mode_enter();
+        break;
+      case MSCDISK_REQUEST_EXIT:
+        storage_mode_exit();
+        break;
+      default:
+        break;
+    }
+    if (mscdisk.active) {
+      continue;
+    }
+
     us = time_us_32();
     if (!pio_sm_is_rx_fifo_empty(pio0, 0)) {
       uint8_t ch = uart_rx_program_getc(pio0, 0);
@@ -902,6 +1134,19 @@ int main() {
     }
 #endif
 
+    // bulk restores land here so a whole scene changes in one pass
+    if (Yoctocore_bulk_apply(&yocto)) {
+      for (uint8_t i = 0; i < 8; i++) {
+        apply_calibration(i);
+      }
+    }
+    Yoctocore_dump_task(&yocto);
+    Yoctocore_download_task(&yocto);
+    Yoctocore_subscription_task(&yocto, to_ms_since_boot(get_absolute_time()));
+    Yoctocore_scope_task(&yocto);
+    Yoctocore_console_task(&yocto);
+    Yoctocore_log_task(&yocto);
+
     // process any mode change
     for (uint8_t i = 0; i < 8; i++) {
       Config *config = &yocto.config[yocto.i][i];
@@ -939,13 +1184,14 @@ int main() {
     }
     timer_per[2] = time_us_32() - us;
 
-    // read buttons
-    for (uint8_t i = 0; i < button_num; i++) {
-      bool val = 1 - gpio_get(button_pins[i]);
+    // handle button edges in the order they happened
+    Buttons_poll(&buttons);
+    ButtonEvent event;
+    while (Buttons_next(&buttons, &event)) {
+      uint8_t i = event.button;
+      bool val = event.pressed;
       if (val != button_values[i]) {
-        uint8_t unique_id;
-        flash_get_unique_id(&unique_id);
-        printf("Button %d: %d (%d)\n", i, val, unique_id);
+        BINLOG(BUTTON, BINLOG_INFO, BUTTON, i, val);
         button_values[i] = val;
         if (i < 8) {
           luaSetButton(i, val);
@@ -954,10 +1200,13 @@ int main() {
           Config *config = &yocto.config[yocto.i][i];
           // check mode
           switch (config->mode) {
-            case MODE_ENVELOPE:
-              // trigger the envelope
-              ADSR_gate(&out->adsr, val, ct);
+            case MODE_ENVELOPE: {
+              // trigger the envelope from when the button was pressed
+              uint32_t status = save_and_disable_interrupts();
+              ADSR_gate(&out->adsr, val, event.time_us / 1000.0);
+              restore_interrupts(status);
               break;
+            }
             case MODE_GATE:
               // set the voltage
               out->voltage_set =
@@ -967,22 +1216,37 @@ int main() {
               if (button_shift && val) {
                 // toggle tuning mode
                 out->tuning = !out->tuning;
-                printf("[out%d] tuning %d\n", i + 1, out->tuning);
+                BINLOG(BUTTON, BINLOG_INFO, TUNING, i + 1, out->tuning);
               }
               break;
             case MODE_CLOCK:
               // start and stop the clock
               if (button_shift && val) {
                 // tap tempo
-                uint16_t bpm_tempo = TapTempo_tap(&out->taptempo);
+                uint16_t bpm_tempo =
+                    TapTempo_tap_at(&out->taptempo, (uint32_t)event.time_us);
                 if (bpm_tempo > 30 && bpm_tempo < 300) {
-                  config->clock_tempo = bpm_tempo;
-                  printf("[out%d] tap tempo %d\n", i + 1, bpm_tempo);
+                  if (config->clock_tempo == 0 && clockout.enabled) {
+                    // leading, tap sets the global tempo
+                    set_global_tempo(bpm_tempo);
+                  } else {
+                    config->clock_tempo = bpm_tempo;
+                  }
+                  BINLOG(BUTTON, BINLOG_INFO, TAP_TEMPO, i + 1, bpm_tempo);
                   Yoctocore_schedule_save(&yocto);
                 }
               } else if (val) {
                 // start/stop
-                out->clock_disabled = !out->clock_disabled;
+                if (config->clock_tempo == 0 && clockout.enabled) {
+                  // leading, start/stop the transport for everyone
+                  if (clockout.running) {
+                    MidiClockOut_stop(&clockout);
+                  } else {
+                    MidiClockOut_start(&clockout);
+                  }
+                } else {
+                  out->clock_disabled = !out->clock_disabled;
+                }
               }
               break;
             case MODE_LFO:
@@ -991,15 +1255,16 @@ int main() {
                 out->lfo_disabled = !out->lfo_disabled;
               }
               break;
-            case MODE_CODE:
+            case MODE_CODE: {
               float volts;
               bool volts_new;
               bool trigger;
-              printf("Lua on_button #%d - val=%d\n", i, val);
+              BINLOG(LUA, BINLOG_DEBUG, LUA_ON_BUTTON, i, val);
               if (luaRunOnButton(i, val, &volts, &volts_new, &trigger)) {
                 on_successful_lua_callback(i, volts, volts_new, trigger);
               }
               break;
+            }
             default:
               break;
           }
@@ -1036,7 +1301,14 @@ int main() {
       bool button_val = button_values[i];
       // check mode
       // make sure modes are up to date
-      if (config->mode == MODE_CLOCK || config->mode == MODE_CODE) {
+      if ((config->mode == MODE_CLOCK || config->mode == MODE_CODE) &&
+          config->clock_tempo == 0 && MidiClock_holding(&midiclock)) {
+        // host transport is stopped, hold clocks following the global tempo
+        if (pool_timer[i].active && config->mode == MODE_CLOCK) {
+          out->voltage_current = config->min_voltage;
+        }
+        SimpleTimer_stop(&pool_timer[i]);
+      } else if (config->mode == MODE_CLOCK || config->mode == MODE_CODE) {
         SimpleTimer_start(&pool_timer[i]);
         // check bpm
         if (config->mode == MODE_CODE) {
@@ -1089,6 +1361,12 @@ int main() {
             // config->lfo_period);
           }
 
+          if (fast_dac_owns(i)) {
+            // stepped by the fast DAC alarm
+            lfo_ct_last[i] = ct;
+            break;
+          }
+          lfo_us_last[i] = 0;
           // NB: `step` is basically how much % of the period got elapsed
           uint32_t elapsed_ms = ct - lfo_ct_last[i];
           lfo_ct_last[i] = ct;
@@ -1157,7 +1435,12 @@ int main() {
         case MODE_CLOCK:
           if (knob_val != -1 && button_val && !button_shift) {
             // set the tempo
-            config->clock_tempo = linlin(knob_val, 0.0f, 1023.0f, 30.0, 300.0);
+            if (config->clock_tempo == 0 && clockout.enabled) {
+              set_global_tempo(linlin(knob_val, 0.0f, 1023.0f, 30.0, 300.0));
+            } else {
+              config->clock_tempo =
+                  linlin(knob_val, 0.0f, 1023.0f, 30.0, 300.0);
+            }
             Yoctocore_schedule_save(&yocto);
           } else if (knob_val != -1 && !button_val && button_shift) {
             // set the division
@@ -1187,6 +1470,10 @@ int main() {
           out->adsr.decay = roundf(config->decay * 1000);
           out->adsr.sustain = config->sustain;
           out->adsr.release = roundf(config->release * 1000);
+          if (fast_dac_owns(i)) {
+            // stepped by the fast DAC alarm
+            break;
+          }
           out->voltage_set = linlin(ADSR_process(&out->adsr, ct), 0.0f, 1.0f,
                                     config->min_voltage, config->max_voltage);
           out->voltage_current = out->voltage_set;
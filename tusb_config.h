@@ -78,10 +78,18 @@ extern "C" {
 
 //------------- CLASS -------------//
 #define CFG_TUD_CDC             PICO_STDIO_USB_ENABLE
+#ifdef INCLUDE_USB_MSC
+#define CFG_TUD_MSC             1
+#else
 #define CFG_TUD_MSC             0
+#endif
 #define CFG_TUD_HID             0
 #define CFG_TUD_MIDI            1
+#ifdef INCLUDE_USB_VENDOR
+#define CFG_TUD_VENDOR          1
+#else
 #define CFG_TUD_VENDOR          0
+#endif
 
 // CDC Configuration
 #define CFG_TUD_CDC_RX_BUFSIZE    (TUD_OPT_HIGH_SPEED ? 512 : 64)
@@ -91,6 +99,13 @@ extern "C" {
 #define CFG_TUD_MIDI_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 #define CFG_TUD_MIDI_TX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 
+// Vendor FIFO size of TX and RX, room for a whole scene frame
+#define CFG_TUD_VENDOR_RX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 64)
+#define CFG_TUD_VENDOR_TX_BUFSIZE 1024
+
+// MSC buffer, one SD card sector
+#define CFG_TUD_MSC_EP_BUFSIZE    512
+
 #ifdef __cplusplus
 }
 #endif
@@ -237,7 +237,19 @@ async function updateLocalScene(scene_num) {
     // get all parameters
 
     let time_per_event = []
-    for (let output_num = 0; output_num < 8; output_num++) {
+    // whole scene in one frame, older firmware does not answer and falls back
+    // to one round trip per parameter
+    let bulk = false;
+    try {
+        const start_time = Date.now();
+        send_sysexbin(SYSEXBIN_DUMP, [scene_num]);
+        await waitForTriggerOrTimeout(500);
+        time_per_event.push(Date.now() - start_time);
+        bulk = true;
+    } catch (error) {
+        console.log('[updateLocalScene] no bulk dump, asking per parameter');
+    }
+    for (let output_num = 0; output_num < 8 && !bulk; output_num++) {
         for (let param of Object.keys(vm.scenes[scene_num].outputs[output_num])) {
             const sysex_string = `${scene_num}_${output_num}_${hash_djb(param)}`;
             // skip code and code_len
@@ -277,7 +289,10 @@ function setupMidiInputListener() {
         window.inputMidiDevice.onmidimessage = (midiMessage) => {
             // check if sysex
             // console.log(midiMessage.data);
-            if (midiMessage.data[0] == 0xf0) {
+            if (midiMessage.data[0] == 0xf0 && midiMessage.data[1] == SYSEXBIN_ID) {
+                last_time_of_message_received = Date.now();
+                handleSysexBin(midiMessage.data.slice(1, midiMessage.data.length - 1));
+            } else if (midiMessage.data[0] == 0xf0) {
                 // convert the sysex to string 
                 last_time_of_message_received = Date.now();
                 var sysex = "";
@@ -452,6 +467,10 @@ function setupMidi() {
                     const sysex_string = `0_0_${hash_djb("scene")}`;
                     console.log(`[sending_sysex] ${sysex_string}`);
                     send_sysex(sysex_string);
+                    // the device pushes changes from now on
+                    send_sysexbin(SYSEXBIN_SUBSCRIBE, [
+                        SUBSCRIPTION_VOLTAGES | SUBSCRIPTION_PARAMS | SUBSCRIPTION_GLOBAL,
+                        0xFF, SUBSCRIPTION_PERIOD_MS & 0xFF, SUBSCRIPTION_PERIOD_MS >> 8]);
                     vm.device_connected = true;
                     break;
                 }
@@ -478,6 +497,322 @@ function send_raw_voltage(channel, voltage) {
     }
 }
 
+// binary protocol, see lib/sysexbin.h
+const SYSEXBIN_ID = 0x7D;
+const SYSEXBIN_VERSION = 1;
+const SYSEXBIN_SET = 0x01;
+const SYSEXBIN_DUMP = 0x04;
+const SYSEXBIN_SCENE = 0x05;
+const SYSEXBIN_ACK = 0x07;
+const SYSEXBIN_SCENE_PARAMS = 23;
+const SYSEXBIN_CODE_BEGIN = 0x08;
+const SYSEXBIN_CODE_DATA = 0x09;
+const SYSEXBIN_CODE_END = 0x0A;
+const SYSEXBIN_CODE_ACK = 0x0B;
+const SYSEXBIN_CODE_CHUNK = 512;
+const SYSEXBIN_SUBSCRIBE = 0x0F;
+const SYSEXBIN_STATE = 0x10;
+const SYSEXBIN_STATE_VOLTAGE = 0x70;
+const SYSEXBIN_STATE_TEMPO = 0x71;
+const SYSEXBIN_CONSOLE = 0x16;
+const SYSEXBIN_SCOPE = 0x11;
+const SYSEXBIN_SCOPE_DATA = 0x12;
+// see lib/scope.h
+const SCOPE_OFF = 0;
+const SCOPE_FREE = 1;
+const SCOPE_RISING = 2;
+const SCOPE_FALLING = 3;
+const SCOPE_HEADER = 6;
+const SCOPE_NO_TRIGGER = 0xFF;
+// see lib/subscription.h
+const SUBSCRIPTION_VOLTAGES = 0x01;
+const SUBSCRIPTION_PARAMS = 0x02;
+const SUBSCRIPTION_GLOBAL = 0x04;
+const SUBSCRIPTION_PERIOD_MS = 50;
+// see lib/codeupload.h
+const CODEUPLOAD_WINDOW = 4;
+const CODEUPLOAD_OK = 0;
+const CODEUPLOAD_SEQUENCE = 1;
+
+function sysexbin_pack7(raw) {
+    let out = [];
+    for (let i = 0; i < raw.length; i += 7) {
+        let head = out.length;
+        let msb = 0;
+        out.push(0);
+        for (let j = 0; j < 7 && i + j < raw.length; j++) {
+            msb |= (raw[i + j] >> 7) << j;
+            out.push(raw[i + j] & 0x7F);
+        }
+        out[head] = msb;
+    }
+    return out;
+}
+
+function sysexbin_unpack7(packed) {
+    let out = [];
+    for (let i = 0; i < packed.length; i += 8) {
+        let msb = packed[i];
+        for (let j = 0; j < 7 && i + 1 + j < packed.length; j++) {
+            out.push(packed[i + 1 + j] | (((msb >> j) & 1) << 7));
+        }
+    }
+    return out;
+}
+
+function sysexbin_crc32(raw) {
+    let crc = 0xFFFFFFFF;
+    for (let i = 0; i < raw.length; i++) {
+        crc ^= raw[i];
+        for (let j = 0; j < 8; j++) {
+            crc = (crc >>> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return (~crc) >>> 0;
+}
+
+function sysexbin_put_u32(raw, val) {
+    raw.push(val & 0xFF, (val >>> 8) & 0xFF, (val >>> 16) & 0xFF, (val >>> 24) & 0xFF);
+}
+
+function sysexbin_get_u32(raw, i) {
+    return (raw[i] | (raw[i + 1] << 8) | (raw[i + 2] << 16) | (raw[i + 3] << 24)) >>> 0;
+}
+
+function sysexbin_param_key(output, param_id) {
+    return Object.keys(output).find(key => Number(hash_djb(key)) == param_id);
+}
+
+function send_sysexbin(command, raw) {
+    if (!window.yoctocoreDevice) {
+        console.warn("No MIDI device connected.");
+        return;
+    }
+    const frame = [0xF0, SYSEXBIN_ID, SYSEXBIN_VERSION, command].concat(sysexbin_pack7(raw));
+    frame.push(0xF7);
+    try {
+        console.log(`[.sendbin] ${command} ${raw.length}`);
+        window.yoctocoreDevice.send(new Uint8Array(frame));
+    } catch (error) {
+        console.error("Failed to send SysEx message:", error);
+    }
+}
+
+// sendSceneBulk restores a whole scene on the device in one transfer
+function sendSceneBulk(scene_num) {
+    let raw = [scene_num, SYSEXBIN_SCENE_PARAMS];
+    for (let output_num = 0; output_num < 8; output_num++) {
+        const output = vm.scenes[scene_num].outputs[output_num];
+        for (let param_id = 0; param_id < SYSEXBIN_SCENE_PARAMS; param_id++) {
+            const key = sysexbin_param_key(output, param_id);
+            const value = key === undefined ? 0 : Number(output[key]);
+            sysexbin_put_u32(raw, Math.round(value * 65536) >>> 0);
+        }
+    }
+    sysexbin_put_u32(raw, sysexbin_crc32(raw));
+    send_sysexbin(SYSEXBIN_SCENE, raw);
+}
+
+// startScope starts the voltage scope, samples arrive in onScopeData as
+// millivolts per channel. Use mode SCOPE_OFF to stop it.
+function startScope(mode, channels = 0xFF, decimation = 1, trigger_channel = 0, trigger_mv = 0, length = 0) {
+    send_sysexbin(SYSEXBIN_SCOPE, [mode, channels, decimation, trigger_channel,
+        trigger_mv & 0xFF, (trigger_mv >> 8) & 0xFF, length & 0xFF, length >> 8]);
+}
+window.startScope = startScope;
+
+let scopeSeq = -1;
+
+function decodeScope(raw) {
+    const count = raw[2];
+    const channels = raw[3];
+    const samples = Array.from({ length: 8 }, () => []);
+    let i = SCOPE_HEADER;
+    for (let ch = 0; ch < 8; ch++) {
+        if (!(channels & (1 << ch))) {
+            continue;
+        }
+        let v = 0;
+        for (let n = 0; n < count; n++) {
+            const delta = (raw[i++] << 24) >> 24;
+            if (delta == -128) {
+                v = ((raw[i] | (raw[i + 1] << 8)) << 16) >> 16;
+                i += 2;
+            } else {
+                v += delta;
+            }
+            samples[ch].push(v);
+        }
+    }
+    const seq = raw[0] | (raw[1] << 8);
+    const lost = scopeSeq >= 0 && seq != ((scopeSeq + 1) & 0xFFFF);
+    scopeSeq = seq;
+    return { samples, trigger: raw[4] == SCOPE_NO_TRIGGER ? -1 : raw[4], overflow: (raw[5] & 1) != 0 || lost };
+}
+
+function onScopeData(batch) {
+    if (window.onScopeData) {
+        window.onScopeData(batch);
+    }
+}
+
+// code acks are queued so none is lost between waits
+let codeAcks = [];
+let codeAckWaiter = null;
+
+function waitForCodeAck(maxWaitTime) {
+    if (codeAcks.length > 0) {
+        return Promise.resolve(codeAcks.shift());
+    }
+    return new Promise((resolve, reject) => {
+        const timeout = setTimeout(() => {
+            codeAckWaiter = null;
+            reject(new Error('Timeout exceeded'));
+        }, maxWaitTime);
+        codeAckWaiter = (ack) => {
+            clearTimeout(timeout);
+            resolve(ack);
+        };
+    });
+}
+
+// uploadCodeBinary streams a script with up to CODEUPLOAD_WINDOW chunks in
+// flight, going back to the device's next expected chunk on a refusal or
+// timeout.
+async function uploadCodeBinary(scene_num, output_num, code) {
+    const bytes = new TextEncoder().encode(code);
+    const num_chunks = Math.ceil(bytes.length / SYSEXBIN_CODE_CHUNK);
+    codeAcks = [];
+    let raw = [scene_num, output_num];
+    sysexbin_put_u32(raw, bytes.length);
+    sysexbin_put_u32(raw, sysexbin_crc32(bytes));
+    send_sysexbin(SYSEXBIN_CODE_BEGIN, raw);
+    let ack = await waitForCodeAck(1000);
+    if (ack.status != CODEUPLOAD_OK) {
+        throw new Error(`upload refused (${ack.status})`);
+    }
+    let acked = 0;
+    let next = 0;
+    let retries = 0;
+    while (acked < num_chunks) {
+        for (; next < num_chunks && next - acked < CODEUPLOAD_WINDOW; next++) {
+            let chunk = [next & 0xFF, next >> 8];
+            chunk.push(...bytes.slice(next * SYSEXBIN_CODE_CHUNK, (next + 1) * SYSEXBIN_CODE_CHUNK));
+            send_sysexbin(SYSEXBIN_CODE_DATA, chunk);
+        }
+        try {
+            ack = await waitForCodeAck(1000);
+        } catch (error) {
+            if (++retries > 5) {
+                throw error;
+            }
+            next = acked;
+            continue;
+        }
+        if (ack.status == CODEUPLOAD_SEQUENCE) {
+            next = ack.next_seq;
+        } else if (ack.status != CODEUPLOAD_OK) {
+            throw new Error(`upload failed (${ack.status})`);
+        }
+        acked = Math.max(acked, ack.next_seq);
+    }
+    send_sysexbin(SYSEXBIN_CODE_END, []);
+    ack = await waitForCodeAck(2000);
+    if (ack.status != CODEUPLOAD_OK) {
+        throw new Error(`upload failed (${ack.status})`);
+    }
+    console.log(`[uploadCodeBinary] ${bytes.length} bytes in ${num_chunks} chunks`);
+}
+
+async function handleSysexBin(data) {
+    if (data[1] != SYSEXBIN_VERSION) {
+        console.log(`[sysexbin] unknown version ${data[1]}`);
+        return;
+    }
+    const command = data[2];
+    const raw = sysexbin_unpack7(data.slice(3));
+    if (command == SYSEXBIN_SCENE) {
+        const crc = sysexbin_get_u32(raw, raw.length - 4);
+        if (crc != sysexbin_crc32(raw.slice(0, raw.length - 4))) {
+            console.log('[sysexbin] scene crc mismatch');
+            return;
+        }
+        const scene_num = raw[0];
+        const params = raw[1];
+        if (!vm.scenes[scene_num]) {
+            return;
+        }
+        disableWatchers = true;
+        let i = 2;
+        for (let output_num = 0; output_num < 8; output_num++) {
+            const output = vm.scenes[scene_num].outputs[output_num];
+            for (let param_id = 0; param_id < params; param_id++) {
+                const key = sysexbin_param_key(output, param_id);
+                const value = Math.round((sysexbin_get_u32(raw, i) | 0) / 65536 * 10000) / 10000;
+                i += 4;
+                if (key !== undefined && output[key] != value) {
+                    output[key] = value;
+                }
+            }
+        }
+        await Vue.nextTick();
+        disableWatchers = false;
+        vm.device_connected = true;
+        externalTrigger();
+    } else if (command == SYSEXBIN_CODE_ACK) {
+        const ack = { next_seq: raw[0] | (raw[1] << 8), status: raw[2] };
+        if (codeAckWaiter) {
+            const waiter = codeAckWaiter;
+            codeAckWaiter = null;
+            waiter(ack);
+        } else {
+            codeAcks.push(ack);
+        }
+    } else if (command == SYSEXBIN_ACK) {
+        console.log(`[sysexbin] ack ${raw[0]} scene ${raw[1]} status ${raw[2]}`);
+    } else if (command == SYSEXBIN_CONSOLE) {
+        // print() from a script on the device, output 0 is the repl
+        const output_num = raw[0];
+        const dropped = raw[5] | (raw[6] << 8);
+        const text = new TextDecoder().decode(new Uint8Array(raw.slice(7)));
+        if (dropped > 0) {
+            console.log(`[device ${output_num}] ... ${dropped} lines dropped`);
+        }
+        console.log(`[device ${output_num}] ${text}`);
+        if (outputCodeMirror && (output_num == 0 || output_num - 1 == vm.current_output)) {
+            outputCodeMirror.setValue(outputCodeMirror.getValue() + `\n${text}`);
+        }
+    } else if (command == SYSEXBIN_SCOPE_DATA) {
+        onScopeData(decodeScope(raw));
+    } else if (command == SYSEXBIN_STATE) {
+        // only what changed since the last frame, empty frames are keepalives
+        disableWatchers = true;
+        for (let i = 0; i + 6 <= raw.length; i += 6) {
+            const scene_num = raw[i] >> 3;
+            const output_num = raw[i] & 0x07;
+            const param_id = raw[i + 1];
+            const value = (sysexbin_get_u32(raw, i + 2) | 0) / 65536;
+            if (param_id == SYSEXBIN_STATE_VOLTAGE) {
+                vm.updateSparkline(output_num, value);
+            } else if (param_id == SYSEXBIN_STATE_TEMPO) {
+                vm.current_bpm = value;
+            } else if (param_id == Number(hash_djb("scene"))) {
+                vm.current_scene = value;
+            } else if (vm.scenes[scene_num]) {
+                const output = vm.scenes[scene_num].outputs[output_num];
+                const key = sysexbin_param_key(output, param_id);
+                const rounded = Math.round(value * 10000) / 10000;
+                if (key !== undefined && output[key] != rounded) {
+                    output[key] = rounded;
+                }
+            }
+        }
+        await Vue.nextTick();
+        disableWatchers = false;
+        vm.device_connected = true;
+    }
+}
+
 function send_sysex(str) {
     if (window.yoctocoreDevice) {
         // Create a Uint8Array with start (0xF0) and end (0xF7) bytes
@@ -760,23 +1095,7 @@ end`,
                 if (window.yoctocoreDevice) {
                     console.log(`[executeLua]: uploading code`);
                     // upload the code to the device.
-                    // split new_code into 32 byte chunks
-                    let chunk_size = 32;
-                    let num_chunks = Math.ceil(new_code.length / chunk_size);
-                    for (let i = 0; i < num_chunks; i++) {
-                        let chunk = new_code.slice(i * chunk_size, (i + 1) * chunk_size);
-                        if (i == 0) {
-                            chunk = `LN${current_scene.value}${current_output.value}${chunk}`;
-                        } else if (i == num_chunks - 1) {
-                            chunk = `LE${current_scene.value}${current_output.value}${chunk}`;
-                        } else {
-                            chunk = `LA${current_scene.value}${current_output.value}${chunk}`;
-                        }
-                        console.log(`[executeLua] ${chunk}`);
-                        // send chunk and wait 10 ms
-                        send_sysex(chunk);
-                        await new Promise(r => setTimeout(r, 10));
-                    }
+                    await uploadCodeBinary(current_scene.value, current_output.value, new_code);
                 }
             } catch (error) {
                 // show error in output
@@ -1029,12 +1348,27 @@ end`,
 
                 // Iterate through each scene and output
                 parseNew.forEach((scene, sceneIndex) => {
+                    // many changes at once (e.g. copying an output) go as one
+                    // bulk scene transfer instead of a message per parameter
+                    let changes = 0;
+                    scene.outputs.forEach((output, outputIndex) => {
+                        const oldOutput = parseOld[sceneIndex]?.outputs[outputIndex];
+                        Object.keys(output).forEach((param) => {
+                            if (param != "code" && output[param] !== oldOutput[param]) {
+                                changes++;
+                            }
+                        });
+                    });
+                    const bulk = changes > 8;
+                    if (bulk) {
+                        sendSceneBulk(sceneIndex);
+                    }
                     scene.outputs.forEach((output, outputIndex) => {
                         const oldOutput = parseOld[sceneIndex]?.outputs[outputIndex];
 
                         // Check for changes in each param
                         Object.keys(output).forEach((param) => {
-                            if (output[param] !== oldOutput[param]) {
+                            if (output[param] !== oldOutput[param] && (!bulk || param == "code")) {
                                 logChange(sceneIndex, outputIndex, param, output[param]);
                             }
                         });